@@ -60,12 +60,21 @@ namespace chip8
         glDebugMessageCallback(MessageCallback, 0);
 
         app.emulator = create_chip8emulator();
+        load_rom_library(app.library, LIB_DEFAULT_INDEX);
         return true;
     }
 
     void destroy_app(App& app) 
     {
         destroy_chip8emulator(app.emulator);
+        if (app.xochip) {
+            destroy_xochip(*app.xochip);
+        }
+        if (app.megachip) {
+            destroy_megachip(*app.megachip);
+        }
+        close_rom_archive(app.archive);
+        destroy_rom_watcher(app.watcher);
 
         // Cleanup
         ImGui_ImplOpenGL3_Shutdown();
@@ -77,272 +86,854 @@ namespace chip8
         SDL_Quit();
     }
 
+    // Call f with the instance of the platform of the loaded ROM
+    template <typename F>
+    static void with_instance(App& app, F&& f)
+    {
+        switch (app.platform) {
+            case Platform::XOCHIP:   f(*app.xochip); break;
+            case Platform::MEGACHIP: f(*app.megachip); break;
+            default:                 f(app.emulator); break;
+        }
+    }
+
+    // Call f with the frames published for the instance of the platform of the loaded ROM
+    template <typename F>
+    static void with_frames(App& app, F&& f)
+    {
+        switch (app.platform) {
+            case Platform::XOCHIP:   f(*app.xochip_frames); break;
+            case Platform::MEGACHIP: f(*app.megachip_frames); break;
+            default:                 f(app.frames); break;
+        }
+    }
+
+    template <typename State>
+    static TripleBuffer<State>& frames_of(App& app)
+    {
+        if constexpr (State::platform == Platform::XOCHIP) {
+            return *app.xochip_frames;
+        } else if constexpr (State::platform == Platform::MEGACHIP) {
+            return *app.megachip_frames;
+        } else {
+            return app.frames;
+        }
+    }
+
+    // Run the next ROM on the instance of platform, allocated the first time
+    // Only call it while the emulation thread is stopped.
+    static void select_platform(App& app, Platform platform)
+    {
+        if (platform == Platform::XOCHIP && !app.xochip) {
+            app.xochip.reset(new XOCHIPState);
+            app.xochip_frames.reset(new TripleBuffer<XOCHIPState>);
+            create_xochip(*app.xochip);
+        } else if (platform == Platform::MEGACHIP && !app.megachip) {
+            app.megachip.reset(new MegaChipState);
+            app.megachip_frames.reset(new TripleBuffer<MegaChipState>);
+            create_megachip(*app.megachip);
+        }
+        app.platform = platform;
+    }
+
+    // Settings of the ROM: its ROM database entry, or for an unknown ROM the platform and quirks
+    // detected by the static analysis of the image (no name, no key, cycles_per_frame 0: the speed is
+    // left as is)
+    static RomInfo find_rom_settings(const uint8_t* rom, size_t size)
+    {
+        if (const RomInfo* info = find_rom_info(rom, size)) {
+            fmt::println("{}: {} ROM, {} quirks, {} instructions per frame", info->name, platform_name(info->platform),
+                         quirk_profile_name(info->quirks), info->cycles_per_frame);
+            return *info;
+        }
+
+        RomAnalysis analysis = analyze_rom(rom, size);
+        fmt::println("Unknown ROM: looks like {}, {} quirks detected", platform_name(analysis.platform),
+                     quirk_profile_name(analysis.quirks));
+
+        RomInfo settings{};
+        settings.platform = analysis.platform;
+        settings.quirks = analysis.quirks;
+        std::fill(std::begin(settings.keys), std::end(settings.keys), ROM_NO_KEY);
+        return settings;
+    }
+
+    // Quirks, speed and keys of the settings, for the ROM just loaded on the instance of their platform
+    static void apply_rom_settings(App& app, const RomInfo& settings)
+    {
+        with_instance(app, [&settings](auto& state) { state.quirks = settings.quirks; });
+        if (settings.cycles_per_frame) {
+            app.nb_cycles.store(static_cast<float>(settings.cycles_per_frame * C8_FRAME_RATE));
+        }
+        std::copy(std::begin(settings.keys), std::end(settings.keys), app.rom_keys);
+    }
+
+    // Returns false (and prints why) if the ROM does not fit in the memory of the platform of the settings
+    static bool fits_platform(const RomInfo& settings, size_t size)
+    {
+        if (size > rom_capacity(settings.platform)) {
+            fmt::println("ROM size ({} bytes) is bigger than the {} memory ({} bytes available)",
+                         size, platform_name(settings.platform), rom_capacity(settings.platform));
+            return false;
+        }
+        return true;
+    }
+
+    // Select the platform of the settings and load the ROM on its instance, see fits_platform
+    static bool load_rom_image(App& app, const RomInfo& settings, const uint8_t* rom, size_t size)
+    {
+        if (!fits_platform(settings, size)) {
+            return false;
+        }
+        select_platform(app, settings.platform);
+        with_instance(app, [rom, size](auto& state) {
+            load_rom_from_buffer(state, const_cast<uint8_t*>(rom), static_cast<int>(size));
+        });
+        apply_rom_settings(app, settings);
+        return true;
+    }
+
+    static bool is_archive(const char* filename)
+    {
+        const char* extension = strrchr(filename, '.');
+        return extension && (strcmp(extension, ".zip") == 0 || strcmp(extension, ".tar") == 0);
+    }
+
+    // Only Patch In Place needs the image the emulator was loaded from
+    static void keep_rom_image(App& app, const RomFile& file)
+    {
+        if (app.hot_patch) {
+            app.rom_image.assign(file.data, file.data + file.size);
+        } else {
+            app.rom_image.clear();
+            app.rom_image.shrink_to_fit();
+        }
+    }
+
     bool load_rom(App& app, const char* filename)
     {
-        std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::ate);
+        if (is_archive(filename)) {
+            if (!open_rom_archive(app.archive, filename) || app.archive.entries.empty()) {
+                return false;
+            }
+            // Archive entries are not watched
+            destroy_rom_watcher(app.watcher);
+            app.rom_path.clear();
+            return load_archive_rom(app, 0);
+        }
 
-        bool ok;
-        if (file.is_open()) {
-            std::streamsize size = file.tellg();
-            file.seekg(0, std::ios::beg);
+        // Mapped, not read: the ROM is copied into the emulator memory, and into rom_image only if
+        // the changes are to be patched in place.
+        // Any size a platform can load, the platform is only known once the ROM is looked up
+        RomFile file;
+        if (!open_rom_file(file, filename, Platform::MEGACHIP)) {
+            return false;
+        }
 
-            char buffer[size];
-            if (file.read(buffer, size))
-            {
-                //TODO: How should I cast array? 
-                //      Is using memcpy the intended way? 
-                //      Should I reinterpret the pointer?
+        if (!load_rom_image(app, find_rom_settings(file.data, file.size), file.data, file.size)) {
+            close_rom_file(file);
+            return false;
+        }
 
-                if (size < C8_MEMORY_SIZE) {
-                    uint8_t* rom = reinterpret_cast<uint8_t*>(buffer);
-                    load_rom_from_buffer(app.emulator, rom, size);
-                    ok = true;
+        app.rom_path = filename;
+        app.rom_stale = false;
+        keep_rom_image(app, file);
+        create_rom_watcher(app.watcher, filename);
 
-                } else {
-                    fmt::println("ROM size is bigger than memory");
-                    ok = false;
-                }
+        close_rom_file(file);
+        return true;
+    }
+
+    // The watched ROM file changed: restart it, or patch it into the running instance.
+    // The platform, quirks and speed in use are kept, the ROM database is not consulted again.
+    static void reload_rom(App& app)
+    {
+        RomFile file;
+        if (!open_rom_file(file, app.rom_path.c_str(), app.platform)) {
+            // Probably still being written, the next write will trigger a reload again
+            return;
+        }
+
+        stop_emulation_thread(app);
+        // A patch needs the image the instance was loaded from, see the Patch In Place toggle
+        with_instance(app, [&app, &file](auto& state) {
+            if (app.hot_patch && !app.rom_image.empty()) {
+                size_t changed = patch_rom(state, app.rom_image.data(), app.rom_image.size(), file.data, file.size);
+                fmt::println("{} reloaded: {} bytes patched", app.rom_path, changed);
+            } else {
+                load_rom_from_buffer(state, const_cast<uint8_t*>(file.data), static_cast<int>(file.size));
+                fmt::println("{} reloaded", app.rom_path);
+            }
+        });
+        start_emulation_thread(app);
+
+        app.rom_stale = false;
+        keep_rom_image(app, file);
+        close_rom_file(file);
+    }
+
+    bool load_archive_rom(App& app, size_t index)
+    {
+        // The platform is looked up on the image: a stored entry is read straight from the mapping
+        if (const uint8_t* rom = archive_entry_data(app.archive, index)) {
+            size_t size = app.archive.entries[index].size;
+            RomInfo settings = find_rom_settings(rom, size);
+            if (!fits_platform(settings, size)) {
+                return false;
             }
+            select_platform(app, settings.platform);
+            bool loaded = false;
+            with_instance(app, [&app, index, &loaded](auto& state) { loaded = load_archive_entry(app.archive, index, state); });
+            apply_rom_settings(app, settings);
+            return loaded;
+        }
+
+        // A compressed one is decompressed once, for the lookup and the load
+        std::vector<uint8_t> rom;
+        if (!read_archive_entry(app.archive, index, rom)) {
+            return false;
+        }
+        return load_rom_image(app, find_rom_settings(rom.data(), rom.size()), rom.data(), rom.size());
+    }
+
+    // Sleep until ~1ms before the deadline, then spin to finish precisely
+    static void sleep_until_precise(std::chrono::steady_clock::time_point deadline)
+    {
+        using clock = std::chrono::steady_clock;
+
+        const auto spin_margin = std::chrono::milliseconds(1);
+        auto now = clock::now();
+        if (deadline - now > spin_margin) {
+            std::this_thread::sleep_for(deadline - now - spin_margin);
+        }
+        while (clock::now() < deadline) {}
+    }
+
+    // Wait for the next frame of the emulation thread, see PacingMode
+    static void sleep_until_frame(PacingMode pacing, std::chrono::steady_clock::time_point deadline)
+    {
+        if (pacing == PacingMode::SleepSpin) {
+            sleep_until_precise(deadline);
         } else {
-            ok = false;
+            std::this_thread::sleep_until(deadline);
         }
+    }
 
-        return ok;
-    } 
+    // Notify the emulation thread of a command. Taking the lock orders the notification after the
+    // check of a thread about to wait, so it cannot be missed.
+    static void wake_emulation(App& app)
+    {
+        { std::lock_guard<std::mutex> lock(app.wake_mutex); }
+        app.wake.notify_one();
+    }
 
-    void run(App& app) {
-        
-        bool done = false;
-        ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
-        ImGuiIO& io = ImGui::GetIO(); (void)io;
+    // Block the paused emulation thread until there is something to do
+    static void wait_for_command(App& app)
+    {
+        std::unique_lock<std::mutex> lock(app.wake_mutex);
+        app.wake.wait(lock, [&app]() {
+            KeyEvent event;
+            return !app.emulation_alive.load(std::memory_order_acquire)
+                   || app.running.load(std::memory_order_relaxed)
+                   || app.step_requests.load(std::memory_order_relaxed) > 0
+                   || spsc_peek(app.key_events, event);
+        });
+    }
 
-        bool running = false;
-        bool step = false;
+    template <typename State>
+    static void publish_frame(TripleBuffer<State>& frames, const State& state)
+    {
+        State& frame = triple_buffer_write(frames);
+        if constexpr (State::memory_size > APP_VIEW_MEMORY_SIZE) {
+            // Everything but the memory past APP_VIEW_MEMORY_SIZE
+            static_assert(offsetof(State, memory) + sizeof(State::memory) == sizeof(State), "The memory must be the last field");
+            memcpy(static_cast<void*>(&frame), &state, offsetof(State, memory) + APP_VIEW_MEMORY_SIZE);
+        } else {
+            frame = state;
+        }
+        triple_buffer_publish(frames);
+    }
 
-        const ImGuiTableFlags tables_flags = ImGuiTableFlags_BordersOuterH | 
-                                             ImGuiTableFlags_BordersOuterV | 
-                                             ImGuiTableFlags_BordersInnerV | 
-                                             ImGuiTableFlags_BordersOuter | 
-                                             ImGuiTableFlags_RowBg | 
-                                             ImGuiTableRowFlags_Headers;
+    // Apply the key events received up to the given (wall clock) time of a cycle boundary.
+    // A key changes at most once per boundary so a press shorter than a cycle is still seen by the ROM.
+    template <typename State>
+    static void apply_key_events(App& app, State& state, std::chrono::steady_clock::time_point boundary)
+    {
+        uint16_t changed = 0;
+        KeyEvent event;
+        while (spsc_peek(app.key_events, event) && event.timestamp <= boundary) {
+            uint16_t mask = 1u << event.key;
+            if (changed & mask) {
+                break;
+            }
+            changed |= mask;
+            set_key(state, event.key, event.pressed);
+            spsc_pop(app.key_events);
+        }
+    }
 
-        MemoryEditor im_mem_edit; // Hex Editor
-        MemoryEditor im_display_edit; // Hex Editor
+    // Apply every key event received up to the given time, without spreading them over cycles
+    template <typename State>
+    static void apply_all_key_events(App& app, State& state, std::chrono::steady_clock::time_point until)
+    {
+        KeyEvent event;
+        while (spsc_peek(app.key_events, event) && event.timestamp <= until) {
+            set_key(state, event.key, event.pressed);
+            spsc_pop(app.key_events);
+        }
+    }
 
-        imgui_addons::ImGuiFileBrowser file_dialog; // File Dialog
+    // The frame running at frame_end covers the inputs received during the previous frame period.
+    // Its cycles are spread evenly over that period so each event lands on its exact cycle.
+    template <typename State>
+    static void emulate_frame_with_inputs(App& app, State& state, unsigned int nb_cycles,
+                                          std::chrono::steady_clock::time_point frame_start,
+                                          std::chrono::steady_clock::time_point frame_end)
+    {
+        // No cycle to place the events on (0 cycles/s): keep the keypad up to date, the queue would fill up
+        if (nb_cycles == 0) {
+            apply_all_key_events(app, state, frame_end);
+        }
 
-        const Uint8 *keystate = SDL_GetKeyboardState(NULL);
+        auto frame_duration = frame_end - frame_start;
+        for (unsigned int i = 0; i < nb_cycles; i++) {
+            apply_key_events(app, state, frame_start + frame_duration * i / nb_cycles);
+            emulate_cycle(state);
+        }
+        update_timers(state);
+    }
 
-        // Create the texture for the display
-        unsigned int tex_display;
-        glCreateTextures(GL_TEXTURE_2D, 1, &tex_display);
-        glTextureParameteri(tex_display, GL_TEXTURE_WRAP_S, GL_REPEAT);	
-        glTextureParameteri(tex_display, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTextureParameteri(tex_display, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTextureParameteri(tex_display, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTextureStorage2D(tex_display, 1, GL_R8, C8_DISPLAY_WIDTH, C8_DISPLAY_HEIGHT);
+    // Runs the instance of the platform of the loaded ROM, state, and publishes it in its frames
+    template <typename State>
+    static void emulation_loop(App& app, State& state)
+    {
+        TripleBuffer<State>& frames = frames_of<State>(app);
+
+        // The loop is paced on the emulated frame rate (60hz). Every frame runs the number of
+        // cycles due for that frame and ticks the timers once; the fractional part is carried over.
+        using clock = std::chrono::steady_clock;
+        const auto frame_period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1. / C8_FRAME_RATE));
+        const int max_late_frames = 4;
+
+        double cycles_due = 0.;
+        auto next_frame = clock::now();
+
+        while (app.emulation_alive.load(std::memory_order_acquire)) {
+            if (app.running.load(std::memory_order_relaxed)) {
+                sleep_until_frame(app.pacing.load(std::memory_order_relaxed), next_frame);
+            } else {
+                // No frame to pace while paused, the missed frames are not caught up on resume
+                wait_for_command(app);
+                next_frame = clock::now();
+            }
 
-        auto cycle_delay = 1.f/300.f;
-        auto time_last_cycle = std::chrono::high_resolution_clock::now();
+            // Catch up on the frames missed, but never more than a few
+            // to avoid spiraling when the host cannot keep up
+            int frames_due = 0;
+            auto now = clock::now();
+            while (next_frame <= now && frames_due < max_late_frames) {
+                next_frame += frame_period;
+                frames_due += 1;
+            }
+            if (next_frame <= now) {
+                next_frame = now + frame_period;
+            }
 
-        while (!done)
-        {
-            SDL_Event event;
-            while (SDL_PollEvent(&event))
-            {
-                ImGui_ImplSDL2_ProcessEvent(&event);
-                if (event.type == SDL_QUIT)
-                    done = true;
-                if (event.type == SDL_WINDOWEVENT 
-                    && event.window.event == SDL_WINDOWEVENT_CLOSE 
-                    && event.window.windowID == SDL_GetWindowID(app.window))
-                    done = true;
+            if (app.running.load(std::memory_order_relaxed)) {
+                float nb_cycles = app.nb_cycles.load(std::memory_order_relaxed);
+                for (int i = frames_due; i > 0; i--) {
+                    cycles_due += nb_cycles / C8_FRAME_RATE;
+                    unsigned int cycles = static_cast<unsigned int>(cycles_due);
+                    cycles_due -= cycles;
+
+                    auto frame_end = next_frame - frame_period * i;
+                    emulate_frame_with_inputs(app, state, cycles, frame_end - frame_period, frame_end);
+                }
+            } else {
+                unsigned int steps = app.step_requests.exchange(0, std::memory_order_relaxed);
+                for (unsigned int i = 0; i < steps; i++) {
+                    apply_key_events(app, state, now);
+                    emulate_cycle(state);
+                }
+                // Keep the keypad up to date while paused
+                apply_all_key_events(app, state, now);
             }
 
-            // Inputs
-            {
-                app.emulator.keypad[0x0] = keystate[SDL_GetScancodeFromKey(SDLK_x)];
-                app.emulator.keypad[0x1] = keystate[SDL_GetScancodeFromKey(SDLK_1)];
-                app.emulator.keypad[0x2] = keystate[SDL_GetScancodeFromKey(SDLK_2)];
-                app.emulator.keypad[0x3] = keystate[SDL_GetScancodeFromKey(SDLK_3)];
-                app.emulator.keypad[0x4] = keystate[SDL_GetScancodeFromKey(SDLK_q)];
-                app.emulator.keypad[0x5] = keystate[SDL_GetScancodeFromKey(SDLK_w)];
-                app.emulator.keypad[0x6] = keystate[SDL_GetScancodeFromKey(SDLK_e)];
-                app.emulator.keypad[0x7] = keystate[SDL_GetScancodeFromKey(SDLK_a)];
-                app.emulator.keypad[0x8] = keystate[SDL_GetScancodeFromKey(SDLK_s)];
-                app.emulator.keypad[0x9] = keystate[SDL_GetScancodeFromKey(SDLK_d)];
-                app.emulator.keypad[0xA] = keystate[SDL_GetScancodeFromKey(SDLK_z)];
-                app.emulator.keypad[0xB] = keystate[SDL_GetScancodeFromKey(SDLK_c)];
-                app.emulator.keypad[0xC] = keystate[SDL_GetScancodeFromKey(SDLK_4)];
-                app.emulator.keypad[0xD] = keystate[SDL_GetScancodeFromKey(SDLK_r)];
-                app.emulator.keypad[0xE] = keystate[SDL_GetScancodeFromKey(SDLK_f)];
-                app.emulator.keypad[0xF] = keystate[SDL_GetScancodeFromKey(SDLK_v)];
+            publish_frame(frames, state);
+        }
+    }
+
+    template <typename State>
+    static void launch_emulation_thread(App& app, State& state)
+    {
+        publish_frame(frames_of<State>(app), state);
+        app.emulation_alive.store(true, std::memory_order_release);
+        app.emulation_thread = std::thread(emulation_loop<State>, std::ref(app), std::ref(state));
+    }
+
+    void start_emulation_thread(App& app)
+    {
+        if (app.emulation_alive.load()) {
+            return;
+        }
+        with_instance(app, [&app](auto& state) { launch_emulation_thread(app, state); });
+    }
+
+    void stop_emulation_thread(App& app)
+    {
+        if (!app.emulation_alive.load()) {
+            return;
+        }
+        app.emulation_alive.store(false, std::memory_order_release);
+        wake_emulation(app);
+        app.emulation_thread.join();
+    }
+
+    // Time of an SDL event on the steady clock. SDL stamps the events (SDL_GetTicks milliseconds) when
+    // it receives them, while they may only be polled once per frame (SleepSpin pacing).
+    static std::chrono::steady_clock::time_point event_time(uint32_t timestamp)
+    {
+        uint32_t age = SDL_GetTicks() - timestamp;
+        return std::chrono::steady_clock::now() - std::chrono::milliseconds(age);
+    }
+
+    static void handle_event(App& app, const SDL_Event& event, bool& done)
+    {
+        ImGui_ImplSDL2_ProcessEvent(&event);
+        if ((event.type == SDL_KEYDOWN && !event.key.repeat) || event.type == SDL_KEYUP) {
+            auto timestamp = event_time(event.key.timestamp);
+            for (uint8_t i = 0; i < C8_KEYPAD_SIZE; i++) {
+                if (KEYMAP[i] == event.key.keysym.sym) {
+                    KeyEvent key_event{timestamp, i, event.type == SDL_KEYDOWN};
+                    if (!spsc_push(app.key_events, key_event)) {
+                        fmt::println("Key event queue is full, input dropped");
+                    }
+                }
+            }
+            for (uint8_t i = 0; i < ROM_KEY_COUNT; i++) {
+                if (ROM_KEYMAP[i] == event.key.keysym.sym && app.rom_keys[i] != ROM_NO_KEY) {
+                    KeyEvent key_event{timestamp, app.rom_keys[i], event.type == SDL_KEYDOWN};
+                    if (!spsc_push(app.key_events, key_event)) {
+                        fmt::println("Key event queue is full, input dropped");
+                    }
+                }
             }
+            wake_emulation(app);
+        }
+        if (event.type == SDL_QUIT)
+            done = true;
+        if (event.type == SDL_WINDOWEVENT 
+            && event.window.event == SDL_WINDOWEVENT_CLOSE 
+            && event.window.windowID == SDL_GetWindowID(app.window))
+            done = true;
+    }
 
-            if (running) {
-                auto time_curr = std::chrono::high_resolution_clock::now();
-                float dt = std::chrono::duration<float, std::chrono::seconds::period>(time_curr - time_last_cycle).count();
+    // Process the incoming events until the deadline of the next frame is reached.
+    // The thread is put to sleep in between so an idle (or paused) emulator does not peg a core.
+    static void wait_for_frame(App& app, std::chrono::steady_clock::time_point deadline, bool& done)
+    {
+        using clock = std::chrono::steady_clock;
+
+        SDL_Event event;
+        switch (app.pacing.load()) {
+            case PacingMode::WaitEvent: {
+                while (!done) {
+                    // SDL timeouts have a millisecond granularity: rounded up, the frame starts late
+                    // rather than spinning the last fraction
+                    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - clock::now()).count();
+                    if (remaining <= 0) {
+                        break;
+                    }
+                    if (SDL_WaitEventTimeout(&event, static_cast<int>(remaining))) {
+                        handle_event(app, event, done);
+                    }
+                }
+                break;
+            }
+            case PacingMode::SleepSpin: {
+                sleep_until_precise(deadline);
+                break;
+            }
+        }
+
+        while (SDL_PollEvent(&event)) {
+            handle_event(app, event, done);
+        }
+    }
 
-                if (dt > cycle_delay)
-                {
-                    time_last_cycle = time_curr;
-                    emulate_cycle(app.emulator);
+    // Thumbnail and run summary of an indexed ROM, drawn with rectangles (no texture per entry)
+    static void draw_library_preview(const RomIndexEntry& entry)
+    {
+        const RomIndexRecord& record = entry.record;
+        const float scale = 3.f;
+
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        ImDrawList* draw_list = ImGui::GetWindowDrawList();
+        draw_list->AddRectFilled(origin, ImVec2(origin.x + LIB_THUMBNAIL_WIDTH * scale, origin.y + LIB_THUMBNAIL_HEIGHT * scale), IM_COL32_BLACK);
+        for (unsigned int y = 0; y < LIB_THUMBNAIL_HEIGHT; y++) {
+            for (unsigned int x = 0; x < LIB_THUMBNAIL_WIDTH; x++) {
+                if (get_thumbnail_pixel(record, x, y)) {
+                    ImVec2 a(origin.x + x * scale, origin.y + y * scale);
+                    draw_list->AddRectFilled(a, ImVec2(a.x + scale, a.y + scale), IM_COL32_WHITE);
                 }
-            } else if (step) {
-                emulate_cycle(app.emulator);
-                step = false;
             }
+        }
+        ImGui::Dummy(ImVec2(LIB_THUMBNAIL_WIDTH * scale, LIB_THUMBNAIL_HEIGHT * scale));
 
-            // Update view only when it is necessary
-            uint8_t image[C8_DISPLAY_WIDTH*C8_DISPLAY_HEIGHT];
-            for(int i =0; i <= C8_DISPLAY_WIDTH * C8_DISPLAY_HEIGHT; i++) {
-                image[i] = app.emulator.display[i] * 0xFF;
+        ImGui::Text("%s, %s quirks%s", platform_name(record.platform), quirk_profile_name(record.quirks),
+                    record.known ? "" : " (detected)");
+        ImGui::Text("%u bytes, %u instructions per frame", static_cast<unsigned int>(record.size), record.cycles_per_frame);
+
+        uint64_t total = 0;
+        for (uint32_t count : record.opcode_mix) {
+            total += count;
+        }
+        for (unsigned int nibble = 0; nibble < 16 && total; nibble++) {
+            if (record.opcode_mix[nibble]) {
+                ImGui::Text("%XNNN: %5.1f%%", nibble, 100. * record.opcode_mix[nibble] / total);
             }
-            glTextureSubImage2D(tex_display, 0, 0, 0, C8_DISPLAY_WIDTH, C8_DISPLAY_HEIGHT, GL_RED, GL_UNSIGNED_BYTE, &image);
+        }
+    }
 
-            // GUI
-            ImGui_ImplOpenGL3_NewFrame();
-            ImGui_ImplSDL2_NewFrame();
-            ImGui::NewFrame();
-            ImGui::DockSpaceOverViewport();
+    // Colour of a pixel of a published frame, in the byte order of the display texture (IM_COL32)
+    static uint32_t display_colour(const CHIP8EmulatorState& view, unsigned int x, unsigned int y)
+    {
+        return get_pixel(view, x, y) ? IM_COL32_WHITE : IM_COL32_BLACK;
+    }
 
-            // Emulator
-            {
-                ImGui::Begin("Emulator");
+    static uint32_t display_colour(const XOCHIPState& view, unsigned int x, unsigned int y)
+    {
+        return XO_COLOURS[get_pixel(view, x, y)];
+    }
+
+    // The screen alpha (05NN) is applied by the blending of the image over the window
+    static uint32_t display_colour(const MegaChipState& view, unsigned int x, unsigned int y)
+    {
+        uint32_t argb = get_pixel(view, x, y);
+        unsigned int alpha = ((argb >> 24) * view.screen_alpha + 0xFFu) >> 8;
+        return IM_COL32((argb >> 16) & 0xFFu, (argb >> 8) & 0xFFu, argb & 0xFFu, alpha);
+    }
+
+    // GUI resources kept across the frames of run
+    struct AppGui {
+        // Sized for the MEGA-CHIP mode, the smaller displays use its top-left corner
+        unsigned int tex_display{};
+        std::vector<uint32_t> pixels = std::vector<uint32_t>(MC_DISPLAY_WIDTH * MC_DISPLAY_HEIGHT);
+
+        MemoryEditor im_mem_edit; // Hex Editor
+        MemoryEditor im_display_edit; // Hex Editor
+        imgui_addons::ImGuiFileBrowser file_dialog; // File Dialog
+    };
+
+    // Windows showing the last published frame (view) of the instance running
+    template <typename State>
+    static void draw_windows(App& app, AppGui& gui, const State& view, bool new_frame)
+    {
+        const ImGuiTableFlags tables_flags = ImGuiTableFlags_BordersOuterH | 
+                                             ImGuiTableFlags_BordersOuterV | 
+                                             ImGuiTableFlags_BordersInnerV | 
+                                             ImGuiTableFlags_BordersOuter | 
+                                             ImGuiTableFlags_RowBg | 
+                                             ImGuiTableRowFlags_Headers;
 
-                if (ImGui::Button("Load")) {
-                    ImGui::OpenPopup("Open File");
-                } ImGui::SameLine();
+        const unsigned int width = display_width(view);
+        const unsigned int height = display_height(view);
 
-                if(file_dialog.showFileDialog("Open File", imgui_addons::ImGuiFileBrowser::DialogMode::OPEN, ImVec2(700, 310), ".ch8")) {
-                    load_rom(app, file_dialog.selected_path.c_str());
+        // Update view only when it is necessary
+        if (new_frame) {
+            for(unsigned int y = 0; y < height; y++) {
+                for(unsigned int x = 0; x < width; x++) {
+                    gui.pixels[x + width*y] = display_colour(view, x, y);
                 }
+            }
+            glTextureSubImage2D(gui.tex_display, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, gui.pixels.data());
+        }
 
-                if (!running) {
-                    if (ImGui::Button("Run")) {
-                        running = true;
-                    }; ImGui::SameLine();
+        // Emulator
+        {
+            ImGui::Begin("Emulator");
 
-                    if (ImGui::Button("Step")) {
-                        step = true;
-                    }
-                } else {
-                    if(ImGui::Button("Stop")) {
-                        running = false;
+            if (ImGui::Button("Load")) {
+                ImGui::OpenPopup("Open File");
+            } ImGui::SameLine();
+
+            if(gui.file_dialog.showFileDialog("Open File", imgui_addons::ImGuiFileBrowser::DialogMode::OPEN, ImVec2(700, 310), ".ch8,.sc8,.xo8,.mc8,.zip,.tar")) {
+                stop_emulation_thread(app);
+                load_rom(app, gui.file_dialog.selected_path.c_str());
+                start_emulation_thread(app);
+            }
+
+            if (!app.running.load()) {
+                if (ImGui::Button("Run")) {
+                    app.running.store(true);
+                    wake_emulation(app);
+                }; ImGui::SameLine();
+
+                if (ImGui::Button("Step")) {
+                    app.step_requests.fetch_add(1);
+                    wake_emulation(app);
+                }
+            } else {
+                if(ImGui::Button("Stop")) {
+                    app.running.store(false);
+                }
+            }
+            ImGui::SameLine();
+            ImGui::Text("%s", platform_name(State::platform));
+
+            ImGui::Separator();
+
+            // The same width whatever the resolution: 64 x 32 at SCALE
+            const float scale = static_cast<float>(C8_DISPLAY_WIDTH * SCALE) / width;
+            ImVec2 visible(static_cast<float>(width) / MC_DISPLAY_WIDTH,
+                           static_cast<float>(height) / MC_DISPLAY_HEIGHT);
+            ImGui::Image((void*)(intptr_t)gui.tex_display, ImVec2(width*scale, height*scale), ImVec2(0, 0), visible);
+            ImGui::End();
+        }
+
+        // Library: preview on hover, double-click to load
+        {
+            ImGui::Begin("Library");
+            if (app.library.entries.empty()) {
+                ImGui::TextWrapped("No ROM indexed, run CHIP8 --index <directory>");
+            }
+            for (const RomIndexEntry& entry : app.library.entries) {
+                if (ImGui::Selectable(entry.path.c_str(), false, ImGuiSelectableFlags_AllowDoubleClick)
+                    && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) {
+                    stop_emulation_thread(app);
+                    load_rom(app, entry.path.c_str());
+                    start_emulation_thread(app);
+                }
+                if (ImGui::IsItemHovered()) {
+                    ImGui::BeginTooltip();
+                    draw_library_preview(entry);
+                    ImGui::EndTooltip();
+                }
+            }
+            if (!app.archive.entries.empty() && ImGui::TreeNodeEx("Archive", ImGuiTreeNodeFlags_DefaultOpen)) {
+                for (size_t i = 0; i < app.archive.entries.size(); i++) {
+                    if (ImGui::Selectable(app.archive.entries[i].name.c_str(), false, ImGuiSelectableFlags_AllowDoubleClick)
+                        && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) {
+                        stop_emulation_thread(app);
+                        load_archive_rom(app, i);
+                        start_emulation_thread(app);
                     }
                 }
+                ImGui::TreePop();
+            }
+            ImGui::End();
+        }
 
-                ImGui::Separator();
+        // Disassembler
+        // Only the first APP_VIEW_MEMORY_SIZE bytes of the memory are published, the MEGA-CHIP display
+        // shown is the blended colours
+        {
+            const size_t memory_size = std::min<size_t>(State::memory_size, APP_VIEW_MEMORY_SIZE);
+            gui.im_mem_edit.DrawWindow("Memory", const_cast<uint8_t*>(view.memory), memory_size, 0);
 
-                ImGui::Image((void*)(intptr_t)tex_display, ImVec2(C8_DISPLAY_WIDTH*10, C8_DISPLAY_HEIGHT*10));
-                ImGui::End();
+            if constexpr (State::platform == Platform::MEGACHIP) {
+                gui.im_display_edit.DrawWindow("Display", const_cast<uint32_t*>(view.colours), sizeof(view.colours), 0);
+            } else {
+                gui.im_display_edit.DrawWindow("Display", const_cast<uint64_t*>(view.display), sizeof(view.display), 0);
             }
+        }
 
-            // Disassembler
+        // Meta
+        {
+            ImGui::Begin("Meta");
+            
+            // cycles per second
             {
-                im_mem_edit.DrawWindow("Memory", &app.emulator.memory, C8_MEMORY_SIZE, 0);
+                float nb_cycles = app.nb_cycles.load();
+                if (ImGui::InputFloat("Cycles/Secs", &nb_cycles)) {
+                    app.nb_cycles.store(std::max(nb_cycles, 0.f));
+                }
+            }
 
-                im_display_edit.DrawWindow("Display", &app.emulator.display, C8_DISPLAY_WIDTH * C8_DISPLAY_HEIGHT, 0);
+            // pacing
+            {
+                const char* pacing_modes[] = { "Wait Event", "Sleep + Spin" };
+                int pacing = static_cast<int>(app.pacing.load());
+                if (ImGui::Combo("Pacing", &pacing, pacing_modes, 2)) {
+                    app.pacing.store(static_cast<PacingMode>(pacing));
+                }
             }
 
-            // Meta
+            // hot reload of the ROM file
             {
-                ImGui::Begin("Meta");
-                
-                // cycle_delay
-                {
-                    static float nb_cycles = 1. / cycle_delay;
-                    if (ImGui::InputFloat("Cycles/Secs", &nb_cycles)) {
-                        cycle_delay = 1. / nb_cycles;
+                ImGui::Checkbox("Hot Reload", &app.hot_reload); ImGui::SameLine();
+                if (ImGui::Checkbox("Patch In Place", &app.hot_patch) && !app.rom_path.empty() && !app.rom_stale) {
+                    // Unchanged since the instance was loaded (or the watcher would have fired): the
+                    // file as it is now is the base of the next patch. Otherwise there is no base
+                    // and the next reload is a full one.
+                    RomFile file;
+                    if (map_rom_file(file, app.rom_path.c_str())) {
+                        keep_rom_image(app, file);
+                        close_rom_file(file);
                     }
                 }
             }
 
-            // Dynamic State
+            // quirks of the loaded ROM
             {
-                ImGui::Begin("Dynamic State");
-
-                ImGui::Text("Instruction"); ImGui::Separator(); ImGui::Indent();
-                {
-                    ImGui::Text("OpCode: 0x%04x", app.emulator.opcode);
+                const char* quirk_profiles[C8_QUIRK_PROFILE_COUNT];
+                for (unsigned int i = 0; i < C8_QUIRK_PROFILE_COUNT; i++) {
+                    quirk_profiles[i] = quirk_profile_name(static_cast<QuirkProfile>(i));
                 }
-                ImGui::Unindent();
+                int quirks = static_cast<int>(view.quirks);
+                if (ImGui::Combo("Quirks", &quirks, quirk_profiles, C8_QUIRK_PROFILE_COUNT)) {
+                    stop_emulation_thread(app);
+                    with_instance(app, [quirks](auto& state) { state.quirks = static_cast<QuirkProfile>(quirks); });
+                    start_emulation_thread(app);
+                }
+            }
+            ImGui::End();
+        }
 
+        // Dynamic State
+        {
+            ImGui::Begin("Dynamic State");
 
-                ImGui::Text("Memory"); ImGui::Separator(); ImGui::Indent();
-                {
-                    ImGui::Text("Pointer Counter: 0x%03x", app.emulator.pc);
-                    if (ImGui::TreeNodeEx("Registers", ImGuiTreeNodeFlags_DefaultOpen)) {
-                        ImGui::Text("I: 0x%03x", app.emulator.I);
-
-                        ImGui::BeginTable("Registers", 2, tables_flags);
-                        ImGui::TableSetupColumn("Vx");
-                        ImGui::TableSetupColumn("Value");
-                        ImGui::TableHeadersRow();
-                        for (unsigned int i = 0; i < C8_REGISTER_SIZE; i++) {
-                            ImGui::TableNextRow();
-                            ImGui::TableNextColumn();
-                            ImGui::Text("V[%2d]", i);
-                            ImGui::TableNextColumn();
-                            ImGui::Text("0x%03x", app.emulator.V[i]);
-                        }   
-                        ImGui::EndTable();
-                        ImGui::TreePop();
-                    }
-                    
-                    if (ImGui::TreeNodeEx("Stack", ImGuiTreeNodeFlags_DefaultOpen)) {
-                        ImGui::Text("sp: %d", app.emulator.sp);
-
-                        ImGui::BeginTable("Stack", 2, tables_flags);
-                        ImGui::TableSetupColumn("Stack[x]");
-                        ImGui::TableSetupColumn("Address");
-                        ImGui::TableHeadersRow();
-                        for (unsigned int i = 0; i < app.emulator.sp; i++) {
-                            ImGui::TableNextRow();
-                            ImGui::TableNextColumn();
-                            ImGui::Text("%2d", i);
-                            ImGui::TableNextColumn();
-                            ImGui::Text("0x%03x", app.emulator.stack[i]);
-                        }   
-                        ImGui::EndTable();
-                        ImGui::TreePop();
-                    }
-                    ImGui::Unindent();
+            ImGui::Text("Instruction"); ImGui::Separator(); ImGui::Indent();
+            {
+                ImGui::Text("OpCode: 0x%04x", view.opcode);
+            }
+            ImGui::Unindent();
+
+
+            ImGui::Text("Memory"); ImGui::Separator(); ImGui::Indent();
+            {
+                ImGui::Text("Pointer Counter: 0x%03x", view.pc);
+                if (ImGui::TreeNodeEx("Registers", ImGuiTreeNodeFlags_DefaultOpen)) {
+                    ImGui::Text("I: 0x%03x", static_cast<unsigned int>(view.I));
+
+                    ImGui::BeginTable("Registers", 2, tables_flags);
+                    ImGui::TableSetupColumn("Vx");
+                    ImGui::TableSetupColumn("Value");
+                    ImGui::TableHeadersRow();
+                    for (unsigned int i = 0; i < C8_REGISTER_SIZE; i++) {
+                        ImGui::TableNextRow();
+                        ImGui::TableNextColumn();
+                        ImGui::Text("V[%2d]", i);
+                        ImGui::TableNextColumn();
+                        ImGui::Text("0x%03x", view.V[i]);
+                    }   
+                    ImGui::EndTable();
+                    ImGui::TreePop();
                 }
                 
-                ImGui::Text("Inputs"); ImGui::Separator(); ImGui::Indent();
-                {
-                    if (ImGui::TreeNodeEx("Keypads", ImGuiTreeNodeFlags_DefaultOpen)) {
-
-                        ImGui::BeginTable("Keypads", 4, tables_flags);
-                        const char* keypads_letters[16] = {
-                            "X", "1", "2", "3", 
-                            "Q", "W", "E", "A", 
-                            "S", "D", "Z", "C",
-                            "4", "R", "F", "V",
-                        };
-
-                        for (unsigned int i = 0; i < C8_KEYPAD_SIZE; i++) {
-                            ImGui::TableNextColumn();
-                            ImGui::Selectable(keypads_letters[i], static_cast<bool>(app.emulator.keypad[i]));
-                        }
-                        ImGui::EndTable();
-                        ImGui::TreePop();
-                    }
+                if (ImGui::TreeNodeEx("Stack", ImGuiTreeNodeFlags_DefaultOpen)) {
+                    ImGui::Text("sp: %d", view.sp);
+
+                    ImGui::BeginTable("Stack", 2, tables_flags);
+                    ImGui::TableSetupColumn("Stack[x]");
+                    ImGui::TableSetupColumn("Address");
+                    ImGui::TableHeadersRow();
+                    for (unsigned int i = 0; i < view.sp; i++) {
+                        ImGui::TableNextRow();
+                        ImGui::TableNextColumn();
+                        ImGui::Text("%2d", i);
+                        ImGui::TableNextColumn();
+                        ImGui::Text("0x%03x", view.stack[i]);
+                    }   
+                    ImGui::EndTable();
+                    ImGui::TreePop();
                 }
                 ImGui::Unindent();
-
-                ImGui::Text("Extra"); ImGui::Separator(); ImGui::Indent();
-                {
-                    if (ImGui::TreeNodeEx("Timers", ImGuiTreeNodeFlags_DefaultOpen)) {
-                        ImGui::Text("Delay Timer: %d", app.emulator.delay_timer);
-                        ImGui::Text("Sound Timer: %d", app.emulator.sound_timer);
-                        ImGui::TreePop();
+            }
+            
+            ImGui::Text("Inputs"); ImGui::Separator(); ImGui::Indent();
+            {
+                if (ImGui::TreeNodeEx("Keypads", ImGuiTreeNodeFlags_DefaultOpen)) {
+
+                    ImGui::BeginTable("Keypads", 4, tables_flags);
+                    const char* keypads_letters[16] = {
+                        "X", "1", "2", "3", 
+                        "Q", "W", "E", "A", 
+                        "S", "D", "Z", "C",
+                        "4", "R", "F", "V",
+                    };
+
+                    for (unsigned int i = 0; i < C8_KEYPAD_SIZE; i++) {
+                        ImGui::TableNextColumn();
+                        ImGui::Selectable(keypads_letters[i], is_key_pressed(view, i));
                     }
+                    ImGui::EndTable();
+                    ImGui::TreePop();
                 }
-                ImGui::Unindent();
-                ImGui::End();
             }
+            ImGui::Unindent();
+
+            ImGui::Text("Extra"); ImGui::Separator(); ImGui::Indent();
+            {
+                if (ImGui::TreeNodeEx("Timers", ImGuiTreeNodeFlags_DefaultOpen)) {
+                    ImGui::Text("Delay Timer: %d", view.delay_timer);
+                    ImGui::Text("Sound Timer: %d", view.sound_timer);
+                    ImGui::TreePop();
+                }
+            }
+            ImGui::Unindent();
+            ImGui::End();
+        }
+    }
+
+    void run(App& app) {
+        
+        bool done = false;
+        ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
+        ImGuiIO& io = ImGui::GetIO(); (void)io;
+
+        AppGui gui;
+
+        // Both editors show the last published frame, edits would be lost
+        gui.im_mem_edit.ReadOnly = true;
+        gui.im_display_edit.ReadOnly = true;
+
+        // Create the texture for the display
+        glCreateTextures(GL_TEXTURE_2D, 1, &gui.tex_display);
+        glTextureParameteri(gui.tex_display, GL_TEXTURE_WRAP_S, GL_REPEAT);	
+        glTextureParameteri(gui.tex_display, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTextureParameteri(gui.tex_display, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(gui.tex_display, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTextureStorage2D(gui.tex_display, 1, GL_RGBA8, MC_DISPLAY_WIDTH, MC_DISPLAY_HEIGHT);
+
+        // The GUI is redrawn at the emulated frame rate, independently of the emulation thread
+        using clock = std::chrono::steady_clock;
+        const auto frame_period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1. / C8_FRAME_RATE));
+        auto next_frame = clock::now();
+
+        start_emulation_thread(app);
+
+        while (!done)
+        {
+            wait_for_frame(app, next_frame, done);
+
+            // Drained even when disabled, so enabling it does not replay old writes. The instance then
+            // runs an older version than the file on disk.
+            if (poll_rom_watcher(app.watcher)) {
+                if (app.hot_reload) {
+                    reload_rom(app);
+                } else {
+                    app.rom_stale = true;
+                }
+            }
+
+            next_frame += frame_period;
+            if (next_frame <= clock::now()) {
+                next_frame = clock::now() + frame_period;
+            }
+
+            // GUI
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplSDL2_NewFrame();
+            ImGui::NewFrame();
+            ImGui::DockSpaceOverViewport();
+
+            // Present the newest complete frame of the platform running
+            with_frames(app, [&app, &gui](auto& frames) {
+                bool new_frame = triple_buffer_acquire(frames);
+                draw_windows(app, gui, triple_buffer_read(frames), new_frame);
+            });
 
             // Rendering
             ImGui::Render();
@@ -352,6 +943,7 @@ namespace chip8
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
             SDL_GL_SwapWindow(app.window);
         }
-        glDeleteTextures(1, &tex_display);
+        stop_emulation_thread(app);
+        glDeleteTextures(1, &gui.tex_display);
     }
 }
\ No newline at end of file
@@ -2,6 +2,11 @@
 #include <fstream>
 #include <iostream>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 
 #include "fmt/core.h"
 //#include "stb_image.h"
@@ -17,24 +22,142 @@
 #include "ImGuiFileBrowser.h"
 
 #include "emulator.h"
+#include "xochip.h"
+#include "megachip.h"
+#include "rom_database.h"
+#include "rom_analysis.h"
+#include "rom_file.h"
+#include "rom_library.h"
+#include "rom_archive.h"
+#include "rom_watcher.h"
+#include "triple_buffer.h"
+#include "spsc_queue.h"
 
 
 namespace chip8
 {
     const int SCALE = 10;
 
+    // Colours of the 4 XO-CHIP pixel values (plane bits), Octo's defaults: background, plane 0,
+    // plane 1, both planes (IM_COL32 byte order, the RGBA texture of the display)
+    const uint32_t XO_COLOURS[4] = {
+        IM_COL32(0x99, 0x66, 0x00, 0xFF), IM_COL32(0xFF, 0xCC, 0x00, 0xFF),
+        IM_COL32(0xFF, 0x66, 0x00, 0xFF), IM_COL32(0x66, 0x22, 0x00, 0xFF),
+    };
+
+    // Bytes of memory copied into a published frame: the whole memory of CHIP-8 and XO-CHIP, the
+    // first 64 KiB of the 16 MiB of MEGA-CHIP (the frames are copied 60 times a second)
+    const size_t APP_VIEW_MEMORY_SIZE = 65536;
+
+    // How the GUI and emulation threads wait for their next frame
+    //  * WaitEvent: only sleep (the GUI in SDL_WaitEventTimeout, waking up early for inputs), the
+    //    frames may start up to a scheduler tick late
+    //  * SleepSpin: sleep until ~1ms before the deadline, then spin to finish precisely (burns a core)
+    // A paused emulation thread never paces: it sleeps until the GUI sends it a command.
+    enum class PacingMode : int {
+        WaitEvent = 0,
+        SleepSpin = 1,
+    };
+
+    // Key transition captured by the GUI thread
+    // * timestamp: when SDL received the event, mapped to a cycle boundary by the emulation thread
+    struct KeyEvent {
+        std::chrono::steady_clock::time_point timestamp;
+        uint8_t key;
+        bool pressed;
+    };
+
+    const size_t KEY_EVENT_QUEUE_SIZE = 1024;
+
+    // Host keys bound to the keypad, indexed by CHIP-8 key
+    const SDL_Keycode KEYMAP[C8_KEYPAD_SIZE] = {
+        SDLK_x, SDLK_1, SDLK_2, SDLK_3,
+        SDLK_q, SDLK_w, SDLK_e, SDLK_a,
+        SDLK_s, SDLK_d, SDLK_z, SDLK_c,
+        SDLK_4, SDLK_r, SDLK_f, SDLK_v,
+    };
+
+    // Extra host keys, bound by the ROM database (indexed by RomKey)
+    const SDL_Keycode ROM_KEYMAP[ROM_KEY_COUNT] = {
+        SDLK_UP, SDLK_DOWN, SDLK_LEFT, SDLK_RIGHT, SDLK_SPACE,
+    };
+
     struct App {
+        // Platform of the loaded ROM: the instance the emulation thread runs and the frames the GUI
+        // shows are the ones of this platform (see with_instance in app.cpp)
+        Platform platform{Platform::CHIP8};
+
+        // Owned by the emulation thread while it is alive.
+        // Only touch them from the GUI after stop_emulation_thread.
+        // The XO-CHIP and MEGA-CHIP instances are allocated when a ROM of their platform is first loaded.
         CHIP8EmulatorState emulator;
+        std::unique_ptr<XOCHIPState> xochip;
+        std::unique_ptr<MegaChipState> megachip;
+
+        // Copy of the state published by the emulation thread after every frame, one per platform.
+        // The GUI only ever reads from there.
+        TripleBuffer<CHIP8EmulatorState> frames;
+        std::unique_ptr<TripleBuffer<XOCHIPState>> xochip_frames;
+        std::unique_ptr<TripleBuffer<MegaChipState>> megachip_frames;
+
+        // Emulation thread
+        std::thread emulation_thread;
+        std::atomic<bool> emulation_alive{false};
+
+        // Commands from the GUI to the emulation thread
+        std::atomic<bool> running{false};
+        std::atomic<unsigned int> step_requests{0};
+        std::atomic<float> nb_cycles{300.f};
+        SPSCQueue<KeyEvent, KEY_EVENT_QUEUE_SIZE> key_events;
+        // Wakes up the paused emulation thread after any of the commands above (see wake_emulation)
+        std::mutex wake_mutex;
+        std::condition_variable wake;
+
+        // CHIP-8 keys bound to ROM_KEYMAP by the ROM database for the loaded ROM (GUI thread only)
+        uint8_t rom_keys[ROM_KEY_COUNT] = {ROM_NO_KEY, ROM_NO_KEY, ROM_NO_KEY, ROM_NO_KEY, ROM_NO_KEY};
+
+        // ROMs indexed by `CHIP8 --index` (LIB_DEFAULT_INDEX), empty if there is no index
+        RomLibrary library;
+        // ROM pack opened by load_rom, its entries are listed in the Library window (GUI thread only)
+        RomArchive archive;
+
+        // Hot reload of the loaded ROM file (GUI thread only)
+        // rom_image is the image the emulator was loaded from, patch_rom diffs the new version against it.
+        // It is only kept while hot_patch is set.
+        RomWatcher watcher;
+        std::string rom_path;
+        std::vector<uint8_t> rom_image;
+        bool hot_reload{true};
+        // Patch the changed bytes into the running instance instead of restarting the ROM
+        bool hot_patch{false};
+        // The file was rewritten while hot_reload was off, it no longer is the image the instance runs
+        bool rom_stale{false};
 
         // Backend
         SDL_Window* window;
         SDL_GLContext gl_context;
+
+        std::atomic<PacingMode> pacing{PacingMode::WaitEvent};
     };
 
     bool create_app(App& app);
 
+    // Load a ROM, with the platform, quirks, speed and keys of its ROM database entry if it has one,
+    // the platform and quirks detected by analyze_rom otherwise. The ROM runs on the instance of its
+    // platform and must fit in its memory (rom_capacity).
+    // A .zip or .tar is opened as a ROM pack instead, and its first ROM is loaded
     bool load_rom(App& app, const char* filename);
 
+    // Load an entry of app.archive, a stored entry is copied straight from the archive into the
+    // emulator memory, a compressed one is decompressed once to find its platform
+    bool load_archive_rom(App& app, size_t index);
+
+    // The emulation runs on its own thread at its own cadence (C8_FRAME_RATE)
+    void start_emulation_thread(App& app);
+
+    // Block until the emulation thread has finished its current frame and exited
+    void stop_emulation_thread(App& app);
+
     void run(App& app);
 
     void destroy_app(App& app);
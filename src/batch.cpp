@@ -0,0 +1,655 @@
+#include <cstring>
+
+#include "batch.h"
+#include "cpu_features.h"
+
+namespace chip8 {
+
+    CHIP8Batch create_chip8batch(size_t nb_instances, const uint8_t* rom, int size, QuirkProfile quirks) {
+        CHIP8EmulatorState prototype = create_chip8emulator();
+        load_rom_from_buffer(prototype, const_cast<uint8_t*>(rom), size);
+        prototype.quirks = quirks;
+        // Only the pages written since the creation may differ from the image (see mark_written)
+        prototype.dirty_pages = 0;
+
+        CHIP8Batch batch;
+        batch.size = nb_instances;
+        batch.quirks = quirks;
+        batch.image.assign(prototype.memory, prototype.memory + C8_MEMORY_SIZE);
+        batch.written.assign(C8_MEMORY_SIZE / 64, 0);
+        batch.states.assign(nb_instances, prototype);
+
+        for (unsigned int r = 0; r < C8_REGISTER_SIZE; r++) {
+            batch.V[r].assign(nb_instances, prototype.V[r]);
+        }
+        batch.pc.assign(nb_instances, prototype.pc);
+        batch.I.assign(nb_instances, prototype.I);
+        batch.rng.assign(nb_instances, prototype.rng);
+        batch.opcode.assign(nb_instances, prototype.opcode);
+        batch.delay_timer.assign(nb_instances, prototype.delay_timer);
+        batch.sound_timer.assign(nb_instances, prototype.sound_timer);
+        batch.keypad.assign(nb_instances, prototype.keypad);
+        batch.sp.assign(nb_instances, prototype.sp);
+        batch.stack.assign(nb_instances * C8_BATCH_STACK_SIZE, 0);
+
+        for (std::vector<uint32_t>& lanes : batch.groups) {
+            lanes.reserve(nb_instances);
+        }
+        batch.pending.reserve(nb_instances);
+
+        return batch;
+    }
+
+    void set_batch_keypad(CHIP8Batch& batch, size_t instance, uint16_t keypad) {
+        batch.keypad[instance] = keypad;
+    }
+
+    CHIP8EmulatorState get_batch_state(const CHIP8Batch& batch, size_t instance) {
+        CHIP8EmulatorState state = batch.states[instance];
+        for (unsigned int r = 0; r < C8_REGISTER_SIZE; r++) {
+            state.V[r] = batch.V[r][instance];
+        }
+        state.pc = batch.pc[instance];
+        state.I = batch.I[instance];
+        state.rng = batch.rng[instance];
+        state.opcode = batch.opcode[instance];
+        state.delay_timer = batch.delay_timer[instance];
+        state.sound_timer = batch.sound_timer[instance];
+        state.keypad = batch.keypad[instance];
+        state.sp = batch.sp[instance];
+        std::copy_n(&batch.stack[instance * C8_BATCH_STACK_SIZE], C8_BATCH_STACK_SIZE, state.stack);
+        return state;
+    }
+
+    void destroy_chip8batch(CHIP8Batch& batch) {
+        for (CHIP8EmulatorState& state : batch.states) {
+            destroy_chip8emulator(state);
+        }
+        batch = CHIP8Batch{};
+    }
+
+    double instructions_per_second(const CHIP8BatchStats& stats) {
+        return stats.seconds > 0. ? stats.instructions / stats.seconds : 0.;
+    }
+
+    ///////////////////////
+    // MEMORY
+    ///////////////////////
+
+    static uint16_t fetch_opcode(const uint8_t* memory, uint16_t pc) {
+        return (memory[pc & (C8_MEMORY_SIZE - 1)] << 8) | memory[(pc + 1) & (C8_MEMORY_SIZE - 1)];
+    }
+
+    // True if an instance may hold other bytes than the image in [address, address + size)
+    static bool is_written(const CHIP8Batch& batch, uint16_t address, unsigned int size) {
+        for (unsigned int k = 0; k < size; k++) {
+            unsigned int a = (address + k) & (C8_MEMORY_SIZE - 1);
+            if ((batch.written[a / 64] >> (a % 64)) & 0b1) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Record the bytes of the memory of an instance differing from the image in [address, address + size)
+    static void mark_written(CHIP8Batch& batch, const CHIP8EmulatorState& state, unsigned int address, unsigned int size) {
+        for (unsigned int k = 0; k < size; k++) {
+            unsigned int a = (address + k) & (C8_MEMORY_SIZE - 1);
+            batch.written[a / 64] |= static_cast<uint64_t>(state.memory[a] != batch.image[a]) << (a % 64);
+        }
+    }
+
+    // Same over the pages the instance wrote
+    static void mark_written(CHIP8Batch& batch, const CHIP8EmulatorState& state) {
+        for (unsigned int page = 0; page < C8_PAGE_COUNT; page++) {
+            if (!((state.dirty_pages >> page) & 0b1)) {
+                continue;
+            }
+            // 8 bytes at a time, most of them being still the ones of the image
+            for (unsigned int address = page * C8_PAGE_SIZE; address < (page + 1) * C8_PAGE_SIZE; address += 8) {
+                uint64_t word, image_word;
+                memcpy(&word, state.memory + address, sizeof(word));
+                memcpy(&image_word, batch.image.data() + address, sizeof(image_word));
+                if (word != image_word) {
+                    mark_written(batch, state, address, 8);
+                }
+            }
+        }
+    }
+
+    ///////////////////////
+    // SCALAR FALLBACK
+    ///////////////////////
+
+    // True if a lane that just executed opcode at from_pc will stay there until the keypad or the
+    // timers change, the remaining cycles of the frame being no-ops (is_stalled of the interpreter)
+    static bool is_stalled(uint16_t opcode, uint16_t keypad, uint16_t pc, uint16_t from_pc) {
+        bool waiting_key = (opcode & 0xF0FFu) == 0xF00Au && !keypad;
+        bool jump_to_self = (opcode & 0xF000u) == 0x1000u;
+        bool exited = opcode == 0x00FDu;
+        return pc == from_pc && (waiting_key || jump_to_self || exited);
+    }
+
+    // The memory of the instance changed: a single FX33 or FX55 (the instructions storing to memory)
+    // only wrote at I, otherwise every page written is compared with the image
+    static void record_writes(CHIP8Batch& batch, const CHIP8EmulatorState& state, uint16_t I, bool single) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        if (single && (state.opcode & 0xF0FFu) == 0xF033u) {
+            mark_written(batch, state, I, 3);
+        } else if (single && (state.opcode & 0xF0FFu) == 0xF055u) {
+            mark_written(batch, state, I, X + 1);
+        } else {
+            mark_written(batch, state);
+        }
+    }
+
+    // Run up to nb_cycles instructions of a single lane with the regular interpreter, stopping early
+    // if the lane stalls. Return the number of instructions executed.
+    static unsigned int emulate_lane(CHIP8Batch& batch, size_t i, unsigned int nb_cycles) {
+        CHIP8EmulatorState& state = batch.states[i];
+
+        for (unsigned int r = 0; r < C8_REGISTER_SIZE; r++) {
+            state.V[r] = batch.V[r][i];
+        }
+        state.pc = batch.pc[i];
+        state.I = batch.I[i];
+        state.rng = batch.rng[i];
+        state.delay_timer = batch.delay_timer[i];
+        state.sound_timer = batch.sound_timer[i];
+        state.keypad = batch.keypad[i];
+        state.sp = batch.sp[i];
+        std::copy_n(&batch.stack[i * C8_BATCH_STACK_SIZE], C8_BATCH_STACK_SIZE, state.stack);
+
+        const uint64_t memory_hash = state.memory_hash;
+        const uint16_t I = state.I;
+        unsigned int c = 0;
+        while (c < nb_cycles) {
+            uint16_t pc = state.pc;
+            emulate_cycle(state);
+            c += 1;
+            if (is_stalled(state.opcode, state.keypad, state.pc, pc)) {
+                break;
+            }
+        }
+
+        for (unsigned int r = 0; r < C8_REGISTER_SIZE; r++) {
+            batch.V[r][i] = state.V[r];
+        }
+        batch.pc[i] = state.pc;
+        batch.I[i] = state.I;
+        batch.rng[i] = state.rng;
+        batch.opcode[i] = state.opcode;
+        batch.delay_timer[i] = state.delay_timer;
+        batch.sound_timer[i] = state.sound_timer;
+        batch.sp[i] = state.sp;
+        std::copy_n(state.stack, C8_BATCH_STACK_SIZE, &batch.stack[i * C8_BATCH_STACK_SIZE]);
+
+        if (state.memory_hash != memory_hash) {
+            record_writes(batch, state, I, c == 1);
+        }
+        return c;
+    }
+
+    // Run one instruction of a single lane with the regular interpreter, only moving the registers it
+    // uses between the columns and the state. The instructions without kernel met the most in a group
+    // (DXYN, 00E0, FX33 and FX55) use no timer, stack or rng; the others go through emulate_lane.
+    static void step_lane(CHIP8Batch& batch, size_t i, uint16_t opcode) {
+        uint8_t X = (opcode & 0x0F00u) >> 8;
+        uint8_t Y = (opcode & 0x00F0u) >> 4;
+        uint16_t registers;
+        if ((opcode & 0xF000u) == 0xD000u) {
+            registers = (1u << X) | (1u << Y);
+        } else if (opcode == 0x00E0u) {
+            registers = 0;
+        } else if ((opcode & 0xF0FFu) == 0xF033u) {
+            registers = 1u << X;
+        } else if ((opcode & 0xF0FFu) == 0xF055u) {
+            registers = (2u << X) - 1;
+        } else {
+            emulate_lane(batch, i, 1);
+            return;
+        }
+
+        CHIP8EmulatorState& state = batch.states[i];
+        for (unsigned int r = 0; r < C8_REGISTER_SIZE; r++) {
+            if ((registers >> r) & 0b1) {
+                state.V[r] = batch.V[r][i];
+            }
+        }
+        state.pc = batch.pc[i];
+        state.I = batch.I[i];
+
+        const uint64_t memory_hash = state.memory_hash;
+        const uint16_t I = state.I;
+        emulate_cycle(state);
+
+        // Only DXYN writes a register (VF, the collision)
+        if ((opcode & 0xF000u) == 0xD000u) {
+            batch.V[0xF][i] = state.V[0xF];
+        }
+        batch.pc[i] = state.pc;
+        batch.I[i] = state.I;
+        batch.opcode[i] = state.opcode;
+
+        if (state.memory_hash != memory_hash) {
+            record_writes(batch, state, I, true);
+        }
+    }
+
+    ///////////////////////
+    // LOCKSTEP KERNELS
+    ///////////////////////
+
+    // Every lane of the batch: plain loops over the columns, vectorized by the compiler
+    struct AllLanes {
+        size_t n;
+
+        template <typename F>
+        void for_each(F f) const {
+            for (size_t i = 0; i < n; i++) f(i);
+        }
+    };
+
+    // Lanes of a group that does not span the batch: compacted indices
+    struct LaneList {
+        const uint32_t* lanes;
+        size_t n;
+
+        template <typename F>
+        void for_each(F f) const {
+            for (size_t k = 0; k < n; k++) f(lanes[k]);
+        }
+    };
+
+    // Execute the opcode on the lanes of a group, all at the same pc
+    // Return false if the opcode has no lockstep kernel; nothing is modified in that case.
+    template <typename Lanes>
+    static bool execute_lockstep(CHIP8Batch& batch, uint16_t opcode, const Lanes& lanes) {
+        uint16_t* pc = batch.pc.data();
+        uint16_t* opcodes = batch.opcode.data();
+        const QuirkSet quirks = quirk_set(batch.quirks);
+
+        uint8_t X = (opcode & 0x0F00u) >> 8;
+        uint8_t Y = (opcode & 0x00F0u) >> 4;
+        uint8_t KK = (opcode & 0x00FFu);
+        uint16_t NNN = (opcode & 0x0FFFu);
+
+        uint8_t* vx = batch.V[X].data();
+        uint8_t* vy = batch.V[Y].data();
+        uint8_t* vf = batch.V[0xF].data();
+        uint8_t* delay_timer = batch.delay_timer.data();
+        uint8_t* sound_timer = batch.sound_timer.data();
+        uint16_t* I = batch.I.data();
+        uint32_t* rng = batch.rng.data();
+        const uint16_t* keypad = batch.keypad.data();
+        uint8_t* sp = batch.sp.data();
+        uint16_t* stack = batch.stack.data();
+
+        // f executes the instruction on lane i and returns its next pc
+        auto run = [&](auto f) {
+            lanes.for_each([&](size_t i) {
+                pc[i] = f(i);
+                opcodes[i] = opcode;
+            });
+            return true;
+        };
+
+        switch (opcode >> 12) {
+            case 0x0: {
+                if (opcode != 0x00EEu) return false;
+                return run([&](size_t i) {
+                    sp[i] -= 1;
+                    return stack[i * C8_BATCH_STACK_SIZE + sp[i] % C8_BATCH_STACK_SIZE];
+                });
+            }
+            case 0x1: return run([&](size_t) { return NNN; });
+            case 0x2: return run([&](size_t i) {
+                stack[i * C8_BATCH_STACK_SIZE + sp[i] % C8_BATCH_STACK_SIZE] = pc[i] + 2;
+                sp[i] += 1;
+                return NNN;
+            });
+            case 0x3: return run([&](size_t i) { return pc[i] + 2 + 2 * (vx[i] == KK); });
+            case 0x4: return run([&](size_t i) { return pc[i] + 2 + 2 * (vx[i] != KK); });
+            case 0x5: {
+                if ((opcode & 0x000Fu) != 0) return false;
+                return run([&](size_t i) { return pc[i] + 2 + 2 * (vx[i] == vy[i]); });
+            }
+            case 0x6: return run([&](size_t i) { vx[i] = KK; return pc[i] + 2; });
+            case 0x7: return run([&](size_t i) { vx[i] += KK; return pc[i] + 2; });
+            case 0x8: {
+                // The new VX and VF are computed from the old values, then written in the order of
+                // the scalar handlers: VF before VX for the arithmetic and the shifts (VX wins when
+                // X == F), the VF reset of 8XY1/8XY2/8XY3 after VX (VF wins)
+                const bool reset = quirks.logic_resets_vf;
+                const uint8_t* source = quirks.shift_uses_vy ? vy : vx;
+                switch (opcode & 0x000Fu) {
+                    case 0x0: return run([&](size_t i) { vx[i] = vy[i]; return pc[i] + 2; });
+                    case 0x1: return run([&](size_t i) { vx[i] |= vy[i]; if (reset) vf[i] = 0; return pc[i] + 2; });
+                    case 0x2: return run([&](size_t i) { vx[i] &= vy[i]; if (reset) vf[i] = 0; return pc[i] + 2; });
+                    case 0x3: return run([&](size_t i) { vx[i] ^= vy[i]; if (reset) vf[i] = 0; return pc[i] + 2; });
+                    case 0x4: return run([&](size_t i) {
+                        uint16_t sum = vx[i] + vy[i];
+                        vf[i] = sum > 0x00FFu;
+                        vx[i] = sum;
+                        return pc[i] + 2;
+                    });
+                    case 0x5: return run([&](size_t i) {
+                        uint8_t x = vx[i], y = vy[i];
+                        vf[i] = x > y;
+                        vx[i] = x - y;
+                        return pc[i] + 2;
+                    });
+                    case 0x6: return run([&](size_t i) {
+                        uint8_t s = source[i];
+                        vf[i] = s & 0b1;
+                        vx[i] = s >> 1;
+                        return pc[i] + 2;
+                    });
+                    case 0x7: return run([&](size_t i) {
+                        uint8_t x = vx[i], y = vy[i];
+                        vf[i] = y > x;
+                        vx[i] = y - x;
+                        return pc[i] + 2;
+                    });
+                    case 0xE: return run([&](size_t i) {
+                        uint8_t s = source[i];
+                        vf[i] = s >> 7;
+                        vx[i] = s << 1;
+                        return pc[i] + 2;
+                    });
+                    default:
+                        return false;
+                }
+            }
+            case 0x9: {
+                if ((opcode & 0x000Fu) != 0) return false;
+                return run([&](size_t i) { return pc[i] + 2 + 2 * (vx[i] != vy[i]); });
+            }
+            case 0xA: return run([&](size_t i) { I[i] = NNN; return pc[i] + 2; });
+            case 0xB: {
+                const uint8_t* v = quirks.jump_uses_vx ? vx : batch.V[0].data();
+                return run([&](size_t i) { return v[i] + NNN; });
+            }
+            case 0xC: return run([&](size_t i) {
+                // xorshift32
+                uint32_t x = rng[i];
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                rng[i] = x;
+                vx[i] = (x >> 24) & KK;
+                return pc[i] + 2;
+            });
+            case 0xE: {
+                switch (KK) {
+                    case 0x9E: return run([&](size_t i) { return pc[i] + 2 + 2 * is_key_pressed(keypad[i], vx[i]); });
+                    case 0xA1: return run([&](size_t i) { return pc[i] + 2 + 2 * !is_key_pressed(keypad[i], vx[i]); });
+                    default:
+                        return false;
+                }
+            }
+            case 0xF: {
+                switch (KK) {
+                    case 0x07: return run([&](size_t i) { vx[i] = delay_timer[i]; return pc[i] + 2; });
+                    case 0x0A: return run([&](size_t i) {
+                        // Highest pressed key, repeat the instruction if none
+                        if (keypad[i]) {
+                            vx[i] = 31 - __builtin_clz(keypad[i]);
+                        }
+                        return pc[i] + 2 * (keypad[i] != 0);
+                    });
+                    case 0x15: return run([&](size_t i) { delay_timer[i] = vx[i]; return pc[i] + 2; });
+                    case 0x18: return run([&](size_t i) { sound_timer[i] = vx[i]; return pc[i] + 2; });
+                    case 0x1E: return run([&](size_t i) { I[i] += vx[i]; return pc[i] + 2; });
+                    case 0x29: return run([&](size_t i) { I[i] = C8_FONTSET_START_ADDRESS + C8_FONT_SIZE * vx[i]; return pc[i] + 2; });
+                    case 0x65: {
+                        uint8_t* v[C8_REGISTER_SIZE];
+                        for (unsigned int r = 0; r <= X; r++) {
+                            v[r] = batch.V[r].data();
+                        }
+                        const uint16_t increment = quirks.load_store_increments_i ? X + 1 : 0;
+                        return run([&](size_t i) {
+                            // The image, unless an instance wrote there
+                            const uint8_t* memory = is_written(batch, I[i], X + 1) ? batch.states[i].memory : batch.image.data();
+                            for (unsigned int r = 0; r <= X; r++) {
+                                v[r][i] = memory[(I[i] + r) & (C8_MEMORY_SIZE - 1)];
+                            }
+                            I[i] += increment;
+                            return pc[i] + 2;
+                        });
+                    }
+                    default:
+                        return false;
+                }
+            }
+            default:
+                return false;
+        }
+    }
+
+    // A group spanning the whole batch runs the kernels without indirection; the loops are compiled
+    // once per instruction set and the widest one supported by the CPU is picked
+    static bool execute_all_lanes(CHIP8Batch& batch, uint16_t opcode) {
+        return execute_lockstep(batch, opcode, AllLanes{batch.size});
+    }
+
+#if defined(C8_AVX2_KERNELS)
+    C8_TARGET_AVX2 __attribute__((flatten)) static bool execute_all_lanes_avx2(CHIP8Batch& batch, uint16_t opcode) {
+        return execute_lockstep(batch, opcode, AllLanes{batch.size});
+    }
+#endif
+
+#if defined(C8_AVX512_KERNELS)
+    C8_TARGET_AVX512BW __attribute__((flatten)) static bool execute_all_lanes_avx512(CHIP8Batch& batch, uint16_t opcode) {
+        return execute_lockstep(batch, opcode, AllLanes{batch.size});
+    }
+#endif
+
+    // Execute the opcode on the count lanes of a group, lanes being ignored when the group spans the batch
+    static bool execute_group(CHIP8Batch& batch, uint16_t opcode, const uint32_t* lanes, size_t count) {
+        if (count < batch.size) {
+            return execute_lockstep(batch, opcode, LaneList{lanes, count});
+        }
+#if defined(C8_AVX512_KERNELS)
+        if (cpu_has_avx512bw()) {
+            return execute_all_lanes_avx512(batch, opcode);
+        }
+#endif
+#if defined(C8_AVX2_KERNELS)
+        if (cpu_has_avx2()) {
+            return execute_all_lanes_avx2(batch, opcode);
+        }
+#endif
+        return execute_all_lanes(batch, opcode);
+    }
+
+    ///////////////////////
+    // CYCLE
+    ///////////////////////
+
+    // Remove the lanes of a group for which keep(i) is false, the others keeping their order
+    template <typename F>
+    static void filter_group(std::vector<uint32_t>& lanes, F keep) {
+        size_t kept = 0;
+        for (uint32_t i : lanes) {
+            if (keep(i)) {
+                lanes[kept++] = i;
+            }
+        }
+        lanes.resize(kept);
+    }
+
+    // Run the lane alone for the remaining cycles of the call
+    static void diverge_lane(CHIP8Batch& batch, uint32_t i, unsigned int nb_cycles) {
+        if (nb_cycles > 0) {
+            batch.stats.instructions += emulate_lane(batch, i, nb_cycles);
+        }
+    }
+
+    // Add the lane to the group at its pc, or to a new group if there is a free one.
+    // Return false if every group is taken.
+    static bool join_group(CHIP8Batch& batch, uint32_t i) {
+        int empty_group = -1;
+        for (unsigned int g = 0; g < C8_BATCH_MAX_GROUPS; g++) {
+            std::vector<uint32_t>& lanes = batch.groups[g];
+            if (lanes.empty()) {
+                empty_group = empty_group < 0 ? g : empty_group;
+            } else if (batch.pc[lanes[0]] == batch.pc[i]) {
+                lanes.push_back(i);
+                return true;
+            }
+        }
+
+        if (empty_group < 0) {
+            return false;
+        }
+        batch.groups[empty_group].push_back(i);
+        return true;
+    }
+
+    // Merge the groups that reached the same pc, then let the lanes alone in their group run on their own
+    static void merge_groups(CHIP8Batch& batch, unsigned int nb_cycles) {
+        for (unsigned int g = 0; g < C8_BATCH_MAX_GROUPS; g++) {
+            std::vector<uint32_t>& lanes = batch.groups[g];
+            for (unsigned int h = g + 1; h < C8_BATCH_MAX_GROUPS && !lanes.empty(); h++) {
+                std::vector<uint32_t>& other = batch.groups[h];
+                if (!other.empty() && batch.pc[other[0]] == batch.pc[lanes[0]]) {
+                    lanes.insert(lanes.end(), other.begin(), other.end());
+                    other.clear();
+                }
+            }
+
+            if (lanes.size() == 1) {
+                diverge_lane(batch, lanes[0], nb_cycles);
+                lanes.clear();
+            }
+        }
+    }
+
+    // True if every lane executing the opcode continues at the same pc, without stalling
+    static bool keeps_group(uint16_t opcode) {
+        switch (opcode >> 12) {
+            case 0x0: return opcode == 0x00E0u;
+            case 0x3: case 0x4: case 0x5: case 0x9: case 0xB: case 0xE: return false;
+            case 0xF: return (opcode & 0x00FFu) != 0x0Au;
+            default: return true;
+        }
+    }
+
+    // Execute one instruction on the lanes of a group, nb_cycles being the cycles left in the call
+    //
+    // The opcode is fetched once from the image. If an instance wrote there, the lanes whose memory
+    // holds another opcode leave the group. After the instruction, the lanes
+    // that stalled are done and the ones that branched away from the others go to pending.
+    static void step_group(CHIP8Batch& batch, unsigned int g, unsigned int nb_cycles) {
+        std::vector<uint32_t>& lanes = batch.groups[g];
+        const uint16_t from_pc = batch.pc[lanes[0]];
+        const uint16_t opcode = fetch_opcode(batch.image.data(), from_pc);
+
+        if (is_written(batch, from_pc, 2)) {
+            filter_group(lanes, [&](uint32_t i) {
+                if (fetch_opcode(batch.states[i].memory, from_pc) == opcode) {
+                    return true;
+                }
+                diverge_lane(batch, i, nb_cycles);
+                return false;
+            });
+            if (lanes.empty()) {
+                return;
+            }
+        }
+
+        if (execute_group(batch, opcode, lanes.data(), lanes.size())) {
+            batch.stats.lockstep_instructions += lanes.size();
+        } else {
+            // No kernel for this opcode: the lanes step with the scalar interpreter but stay together
+            for (uint32_t i : lanes) {
+                step_lane(batch, i, opcode);
+            }
+        }
+        batch.stats.instructions += lanes.size();
+
+        if ((opcode & 0xF000u) == 0x1000u && (opcode & 0x0FFFu) == from_pc) {
+            // Jump to itself: every lane is stalled until the end of the call
+            lanes.clear();
+            return;
+        }
+        if (keeps_group(opcode)) {
+            return;
+        }
+
+        const uint16_t to_pc = batch.pc[lanes[0]];
+        filter_group(lanes, [&](uint32_t i) {
+            if (is_stalled(opcode, batch.keypad[i], batch.pc[i], from_pc)) {
+                return false;
+            }
+            if (batch.pc[i] != to_pc) {
+                batch.pending.push_back(i);
+                return false;
+            }
+            return true;
+        });
+    }
+
+    // Execute up to nb_cycles instructions on every instance, a stalled instance stopping early
+    //
+    // The lanes are sorted in groups by pc at the start, the first C8_BATCH_MAX_GROUPS distinct pcs
+    // met get a group. A group executes each instruction once for all its lanes; a group spanning the
+    // whole batch runs the kernels directly over the columns. The lanes that branch away from their
+    // group join the group at their new pc, or a free one, after the cycle.
+    //
+    // A lane that finds no group (or is alone in its group) has diverged: it runs its remaining cycles
+    // at once with the scalar interpreter, while its state is in cache, and only rejoins the others
+    // at the next call.
+    static void emulate_batch_cycles(CHIP8Batch& batch, unsigned int nb_cycles) {
+        for (std::vector<uint32_t>& lanes : batch.groups) {
+            lanes.clear();
+        }
+        for (size_t i = 0; i < batch.size; i++) {
+            if (!join_group(batch, i)) {
+                diverge_lane(batch, i, nb_cycles);
+            }
+        }
+        merge_groups(batch, nb_cycles);
+
+        for (unsigned int c = 0; c < nb_cycles; c++) {
+            bool running = false;
+            batch.pending.clear();
+            for (unsigned int g = 0; g < C8_BATCH_MAX_GROUPS; g++) {
+                if (!batch.groups[g].empty()) {
+                    step_group(batch, g, nb_cycles - c);
+                    running = true;
+                }
+            }
+            if (!running) {
+                break;
+            }
+
+            for (uint32_t i : batch.pending) {
+                if (!join_group(batch, i)) {
+                    diverge_lane(batch, i, nb_cycles - c - 1);
+                }
+            }
+            merge_groups(batch, nb_cycles - c - 1);
+        }
+    }
+
+    void emulate_batch_cycle(CHIP8Batch& batch) {
+        emulate_batch_cycles(batch, 1);
+    }
+
+    void emulate_batch_frame(CHIP8Batch& batch, unsigned int nb_cycles) {
+        auto start = std::chrono::steady_clock::now();
+
+        emulate_batch_cycles(batch, nb_cycles);
+
+        uint8_t* delay_timer = batch.delay_timer.data();
+        uint8_t* sound_timer = batch.sound_timer.data();
+        for (size_t i = 0; i < batch.size; i++) {
+            delay_timer[i] -= delay_timer[i] > 0;
+            sound_timer[i] -= sound_timer[i] > 0;
+        }
+
+        batch.stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
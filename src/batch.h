@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    // Maximum number of distinct pc groups advanced in lockstep per cycle.
+    // Lanes outside of those groups fall back to the scalar interpreter.
+    const unsigned int C8_BATCH_MAX_GROUPS = 4;
+
+    // Levels of the stack of an instance
+    const unsigned int C8_BATCH_STACK_SIZE = sizeof(CHIP8EmulatorState::stack) / sizeof(uint16_t);
+
+    struct CHIP8BatchStats {
+        // Instructions executed, all lanes included
+        uint64_t instructions{};
+
+        // Part of the instructions executed by the lockstep (vector) kernels
+        uint64_t lockstep_instructions{};
+
+        // Time spent in emulate_batch_frame
+        double seconds{};
+    };
+
+    // Structure-of-arrays batch of CHIP-8 instances
+    //
+    // The registers, pc, I, opcode, rng, timers, keypad and stack of the N instances are stored column-wise
+    // so an instruction shared by many instances is executed with vector instructions over the columns.
+    // Memory and display are only written by the scalar path and stay in a regular state per instance.
+    //
+    // Every instance starts from the same memory (image): the opcodes are fetched once per distinct pc
+    // from the image, the instances only read their own memory where one of them wrote (written).
+    struct CHIP8Batch {
+        size_t size{};
+
+        ////// Columns (hot) ///////
+        std::vector<uint8_t> V[C8_REGISTER_SIZE];
+        std::vector<uint16_t> pc;
+        std::vector<uint16_t> I;
+        std::vector<uint16_t> opcode;
+        std::vector<uint32_t> rng;
+        std::vector<uint8_t> delay_timer;
+        std::vector<uint8_t> sound_timer;
+        std::vector<uint16_t> keypad;
+        std::vector<uint8_t> sp;
+        // * C8_BATCH_STACK_SIZE levels per instance, instance after instance
+        std::vector<uint16_t> stack;
+
+        ////// Shared ///////
+        // * memory of every instance when the batch was created (fonts and ROM)
+        std::vector<uint8_t> image;
+        // * bit per address, set once an instance held another byte than the image there
+        std::vector<uint64_t> written;
+
+        // * Quirk profile shared by every instance, also followed by the lockstep kernels
+        QuirkProfile quirks{};
+
+        ////// Per instance (cold) ///////
+        // * The fields mirrored by the columns are only valid after get_batch_state
+        std::vector<CHIP8EmulatorState> states;
+
+        ////// Scratch ///////
+        // * groups: lanes advanced in lockstep, all at the same pc (empty if unused)
+        // * pending: lanes that branched away from their group during the current cycle
+        std::vector<uint32_t> groups[C8_BATCH_MAX_GROUPS];
+        std::vector<uint32_t> pending;
+
+        CHIP8BatchStats stats;
+    };
+
+    // Create nb_instances instances running the same ROM with the same quirk profile
+    CHIP8Batch create_chip8batch(size_t nb_instances, const uint8_t* rom, int size,
+                                 QuirkProfile quirks = QuirkProfile::Default);
+
+    void set_batch_keypad(CHIP8Batch& batch, size_t instance, uint16_t keypad);
+
+    // Full state of one instance (columns gathered back into a regular state)
+    CHIP8EmulatorState get_batch_state(const CHIP8Batch& batch, size_t instance);
+
+    // Execute one instruction on every instance. Timers are left untouched.
+    void emulate_batch_cycle(CHIP8Batch& batch);
+
+    // Execute nb_cycles instructions on every instance followed by one timer tick
+    void emulate_batch_frame(CHIP8Batch& batch, unsigned int nb_cycles);
+
+    // Aggregate emulated instructions per second over all instances
+    double instructions_per_second(const CHIP8BatchStats& stats);
+
+    void destroy_chip8batch(CHIP8Batch& batch);
+}
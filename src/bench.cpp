@@ -0,0 +1,266 @@
+// Headless throughput of the CHIP-8 interpreter
+//
+// CHIP8_bench [--instances N] [--frames N] [--cycles N] <rom>...
+//
+// Every ROM is run by arrays of 1 and N instances, stepped one frame each in turn, with two layouts
+// of the same state:
+//  * hot/cold: CHIP8EmulatorState, the fields touched by every instruction in its first cache line
+//  * interleaved: CHIP8InterleavedState, the field order before the split (registers on both sides
+//    of the 4 KiB memory)
+// Both run the same interpreter (interpreter.h, chip8_access.h), only the layout differs.
+//
+// The N instances are then run again with keys pressed at different frames per instance so they
+// diverge, once as N scalar hot/cold states and once as a CHIP8Batch (batch.h).
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "batch.h"
+#include "emulator.h"
+#include "interpreter.h"
+#include "chip8_access.h"
+#include "rom_file.h"
+
+namespace chip8 {
+
+    // Fields of CHIP8EmulatorState in the order of the state before the hot/cold split, the fields
+    // added since then next to their closest baseline neighbour
+    struct CHIP8InterleavedState {
+        static constexpr Platform platform = Platform::CHIP8;
+        static constexpr unsigned int memory_size = C8_MEMORY_SIZE;
+
+        uint8_t V[C8_REGISTER_SIZE]{};
+        uint8_t memory[C8_MEMORY_SIZE]{};
+
+        uint16_t pc{};
+        uint16_t opcode{};
+        uint16_t I{};
+        uint16_t stack[16]{};
+        uint8_t sp{};
+
+        uint8_t delay_timer{};
+        uint8_t sound_timer{};
+
+        uint16_t keypad{};
+        uint32_t rng{C8_DEFAULT_SEED};
+
+        uint8_t hires{};
+        uint64_t display[C8_HIRES_HEIGHT * C8_DISPLAY_ROW_WORDS]{};
+
+        uint16_t dirty_pages{};
+        bool dirty_display{};
+        QuirkProfile quirks{};
+        uint64_t memory_hash{};
+        uint64_t display_hash{};
+        uint8_t rpl[C8_RPL_FLAGS_SIZE]{};
+    };
+
+    inline unsigned int display_width(const CHIP8InterleavedState& state) {
+        return state.hires ? C8_HIRES_WIDTH : C8_DISPLAY_WIDTH;
+    }
+
+    inline unsigned int display_height(const CHIP8InterleavedState& state) {
+        return state.hires ? C8_HIRES_HEIGHT : C8_DISPLAY_HEIGHT;
+    }
+
+    // Same start as create_chip8emulator followed by load_rom_from_buffer
+    static void load_interleaved(CHIP8InterleavedState& state, const uint8_t* rom, size_t size) {
+        state = CHIP8InterleavedState{};
+        state.pc = C8_START_ADDRESS;
+        std::copy(C8_FONTSET, C8_FONTSET + C8_FONTSET_SIZE, state.memory + C8_FONTSET_START_ADDRESS);
+        std::copy(C8_BIGFONTSET, C8_BIGFONTSET + C8_BIGFONTSET_SIZE, state.memory + C8_BIGFONTSET_START_ADDRESS);
+        std::copy(rom, rom + size, state.memory + C8_START_ADDRESS);
+        for (unsigned int address = 0; address < C8_MEMORY_SIZE; address++) {
+            state.memory_hash ^= location_hash(address, state.memory[address]);
+        }
+    }
+}
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchResult {
+    uint64_t nb_cycles{};
+    double seconds{};
+    // Distinct cache lines holding the fields read or written by every instruction, per instance
+    double hot_lines{};
+    // pc, I and registers of the first instance at the end, to check both layouts ran the same program
+    uint64_t check{};
+};
+
+// Cache lines of the hot fields (registers, pc, I, opcode, keypad, sp, timers, rng, stack)
+template <typename State>
+static size_t count_hot_lines(const State& state) {
+    const std::pair<const void*, size_t> fields[] = {
+        {state.V, sizeof(state.V)}, {&state.pc, sizeof(state.pc)}, {&state.I, sizeof(state.I)},
+        {&state.opcode, sizeof(state.opcode)}, {&state.keypad, sizeof(state.keypad)}, {&state.sp, sizeof(state.sp)},
+        {&state.delay_timer, sizeof(state.delay_timer)}, {&state.sound_timer, sizeof(state.sound_timer)},
+        {&state.rng, sizeof(state.rng)}, {state.stack, sizeof(state.stack)},
+    };
+
+    std::set<uintptr_t> lines;
+    for (const auto& field : fields) {
+        uintptr_t first = reinterpret_cast<uintptr_t>(field.first);
+        for (uintptr_t line = first / chip8::C8_CACHE_LINE_SIZE; line <= (first + field.second - 1) / chip8::C8_CACHE_LINE_SIZE; line++) {
+            lines.insert(line);
+        }
+    }
+    return lines.size();
+}
+
+static void load_instance(chip8::CHIP8EmulatorState& state, const chip8::RomFile& rom) {
+    state = chip8::create_chip8emulator();
+    chip8::load_rom_from_buffer(state, const_cast<uint8_t*>(rom.data), static_cast<int>(rom.size));
+}
+
+static void load_instance(chip8::CHIP8InterleavedState& state, const chip8::RomFile& rom) {
+    chip8::load_interleaved(state, rom.data, rom.size);
+}
+
+template <typename State>
+static BenchResult run_instances(const chip8::RomFile& rom, unsigned int nb_instances, unsigned int nb_frames,
+                                 unsigned int nb_cycles) {
+    std::unique_ptr<State[]> states(new State[nb_instances]);
+    BenchResult result;
+    for (unsigned int i = 0; i < nb_instances; i++) {
+        load_instance(states[i], rom);
+        result.hot_lines += count_hot_lines(states[i]);
+    }
+    result.hot_lines /= nb_instances;
+
+    auto start = Clock::now();
+    for (unsigned int f = 0; f < nb_frames; f++) {
+        for (unsigned int i = 0; i < nb_instances; i++) {
+            result.nb_cycles += chip8::interpret_frame(states[i], nb_cycles);
+        }
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    result.check = (static_cast<uint64_t>(states[0].pc) << 48) | (static_cast<uint64_t>(states[0].I) << 32)
+                   | chip8::hash_bytes(0, states[0].V, sizeof(states[0].V)) >> 32;
+    return result;
+}
+
+// Keys of an instance during a frame in the batch comparison: one key per instance, pressed one
+// time in seven at a different phase for each instance
+static uint16_t bench_keypad(unsigned int instance, unsigned int frame) {
+    return (frame / 20 + instance) % 7 == 0 ? 1u << (instance % 16) : 0;
+}
+
+static BenchResult run_scalar(const chip8::RomFile& rom, unsigned int nb_instances, unsigned int nb_frames,
+                              unsigned int nb_cycles) {
+    std::vector<chip8::CHIP8EmulatorState> states(nb_instances);
+    for (chip8::CHIP8EmulatorState& state : states) {
+        load_instance(state, rom);
+    }
+
+    BenchResult result;
+    auto start = Clock::now();
+    for (unsigned int f = 0; f < nb_frames; f++) {
+        for (unsigned int i = 0; i < nb_instances; i++) {
+            states[i].keypad = bench_keypad(i, f);
+            result.nb_cycles += chip8::interpret_frame(states[i], nb_cycles);
+        }
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (const chip8::CHIP8EmulatorState& state : states) {
+        result.check = result.check * 31 + chip8::hash_state(state);
+    }
+    return result;
+}
+
+static BenchResult run_batch(const chip8::RomFile& rom, unsigned int nb_instances, unsigned int nb_frames,
+                             unsigned int nb_cycles, chip8::CHIP8BatchStats& stats) {
+    chip8::CHIP8Batch batch = chip8::create_chip8batch(nb_instances, rom.data, static_cast<int>(rom.size));
+    for (unsigned int f = 0; f < nb_frames; f++) {
+        for (unsigned int i = 0; i < nb_instances; i++) {
+            chip8::set_batch_keypad(batch, i, bench_keypad(i, f));
+        }
+        chip8::emulate_batch_frame(batch, nb_cycles);
+    }
+
+    BenchResult result;
+    stats = batch.stats;
+    result.nb_cycles = stats.instructions;
+    result.seconds = stats.seconds;
+    for (unsigned int i = 0; i < nb_instances; i++) {
+        result.check = result.check * 31 + chip8::hash_state(chip8::get_batch_state(batch, i));
+    }
+    chip8::destroy_chip8batch(batch);
+    return result;
+}
+
+static void print_result(const char* layout, unsigned int nb_instances, const BenchResult& result) {
+    double seconds = std::max(result.seconds, 1e-9);
+    double nb_cycles = static_cast<double>(std::max<uint64_t>(result.nb_cycles, 1));
+    fmt::println("  {:<12} {:>6} {:>12} {:>9.3f} ms {:>8.2f} Mcycles/s {:>7.2f} ns/cycle {:>5.2f}",
+                 layout, nb_instances, result.nb_cycles, seconds * 1e3, nb_cycles / seconds * 1e-6,
+                 seconds * 1e9 / nb_cycles, result.hot_lines);
+}
+
+int main(int argc, char** argv) {
+    unsigned int nb_instances = 1024;
+    unsigned int nb_frames = 600;
+    unsigned int nb_cycles = 10;
+
+    std::vector<const char*> roms;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--instances") == 0 && a + 1 < argc) {
+            nb_instances = std::max(1, atoi(argv[++a]));
+        } else if (strcmp(argv[a], "--frames") == 0 && a + 1 < argc) {
+            nb_frames = std::max(1, atoi(argv[++a]));
+        } else if (strcmp(argv[a], "--cycles") == 0 && a + 1 < argc) {
+            nb_cycles = std::max(1, atoi(argv[++a]));
+        } else {
+            roms.push_back(argv[a]);
+        }
+    }
+    if (roms.empty()) {
+        fmt::println("Usage: CHIP8_bench [--instances N] [--frames N] [--cycles N] <rom>...");
+        return 1;
+    }
+
+    fmt::println("hot/cold: {} bytes per instance, interleaved: {} bytes per instance",
+                 sizeof(chip8::CHIP8EmulatorState), sizeof(chip8::CHIP8InterleavedState));
+    fmt::println("  layout, instances, cycles, time, throughput, hot cache lines per instance");
+
+    for (const char* filename : roms) {
+        chip8::RomFile rom;
+        if (!chip8::open_rom_file(rom, filename)) {
+            continue;
+        }
+
+        fmt::println("{}", filename);
+        for (unsigned int n : {1u, nb_instances}) {
+            BenchResult split = run_instances<chip8::CHIP8EmulatorState>(rom, n, nb_frames, nb_cycles);
+            BenchResult interleaved = run_instances<chip8::CHIP8InterleavedState>(rom, n, nb_frames, nb_cycles);
+            print_result("hot/cold", n, split);
+            print_result("interleaved", n, interleaved);
+            if (split.check != interleaved.check || split.nb_cycles != interleaved.nb_cycles) {
+                fmt::println("  the two layouts did not run the same program");
+            }
+        }
+
+        // The batch runs every cycle of a frame while a scalar instance stops at a stall (is_stalled),
+        // both are compared on the time to emulate the same frames
+        chip8::CHIP8BatchStats stats;
+        BenchResult scalar = run_scalar(rom, nb_instances, nb_frames, nb_cycles);
+        BenchResult batch = run_batch(rom, nb_instances, nb_frames, nb_cycles, stats);
+        double lockstep = static_cast<double>(stats.lockstep_instructions) / std::max<uint64_t>(stats.instructions, 1);
+        fmt::println("  {:<12} {:>6} {:>12} {:>9.3f} ms", "scalar", nb_instances, scalar.nb_cycles, scalar.seconds * 1e3);
+        fmt::println("  {:<12} {:>6} {:>12} {:>9.3f} ms {:>8.2f} Minstructions/s, {:.0f}% lockstep, {:.2f}x scalar",
+                     "batch", nb_instances, batch.nb_cycles, batch.seconds * 1e3,
+                     chip8::instructions_per_second(stats) * 1e-6,
+                     lockstep * 100., scalar.seconds / std::max(batch.seconds, 1e-9));
+        if (scalar.check != batch.check) {
+            fmt::println("  the batch did not end in the same states as the scalar instances");
+        }
+
+        chip8::close_rom_file(rom);
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "emulator.h"
+#include "interpreter.h"
+
+// State access of the CHIP-8 state (see interpreter.h), as templates on the state type
+//
+// They only rely on the fields of CHIP8EmulatorState, not on their order: CHIP8_bench instantiates
+// them, and the interpreter, on the field order of the state before its hot/cold split.
+//
+// Only include from the translation units implementing a CHIP-8 state type (emulator.cpp, bench.cpp).
+namespace chip8 {
+
+    // Hash of a display word at index (row * C8_DISPLAY_ROW_WORDS + word) for the display hash
+    inline uint64_t display_word_hash(unsigned int index, uint64_t word) {
+        return location_word_hash(C8_MEMORY_SIZE + index, word);
+    }
+
+    template <typename State>
+    void rehash_display(State& state) {
+        state.display_hash = 0;
+        for (unsigned int index = 0; index < C8_HIRES_HEIGHT * C8_DISPLAY_ROW_WORDS; index++) {
+            state.display_hash ^= display_word_hash(index, state.display[index]);
+        }
+    }
+
+    // XOR mask into a display word, return true if a lit pixel was turned off
+    template <typename State>
+    inline bool xor_display_word(State& state, unsigned int index, uint64_t mask) {
+        uint64_t word = state.display[index];
+        state.display_hash ^= display_word_hash(index, word) ^ display_word_hash(index, word ^ mask);
+        state.display[index] = word ^ mask;
+        return (word & mask) != 0;
+    }
+
+    ///////////////////////
+    // STATE ACCESS (see interpreter.h)
+    ///////////////////////
+
+    // Every memory write of the instructions goes through here to keep memory_hash and dirty_pages up to date
+    template <typename State>
+    inline void write_memory(State& state, unsigned int address, uint8_t value) {
+        address &= C8_MEMORY_SIZE - 1;
+        state.memory_hash ^= location_hash(address, state.memory[address]) ^ location_hash(address, value);
+        state.memory[address] = value;
+        state.dirty_pages |= 1u << (address / C8_PAGE_SIZE);
+    }
+
+    template <typename State>
+    void clear_display(State& state) {
+        memset(state.display, 0, sizeof(state.display));
+        state.dirty_display = true;
+        state.display_hash = 0;
+    }
+
+    template <typename State>
+    void set_resolution(State& state, bool hires) {
+        state.hires = hires;
+        clear_display(state);
+    }
+
+    template <typename State>
+    void scroll_display_down(State& state, unsigned int n) {
+        const unsigned int height = display_height(state);
+
+        // Whole rows are moved, the words of a row stay together
+        memmove(&state.display[n * C8_DISPLAY_ROW_WORDS], state.display, (height - n) * C8_DISPLAY_ROW_WORDS * sizeof(uint64_t));
+        memset(state.display, 0, n * C8_DISPLAY_ROW_WORDS * sizeof(uint64_t));
+
+        state.dirty_display = true;
+        rehash_display(state);
+    }
+
+    template <typename State>
+    void scroll_display_right(State& state) {
+        const unsigned int height = display_height(state);
+        for (unsigned int y = 0; y < height; y++) {
+            uint64_t* row = &state.display[y * C8_DISPLAY_ROW_WORDS];
+            row[1] = state.hires ? (row[1] >> 4) | (row[0] << 60) : 0;
+            row[0] = row[0] >> 4;
+        }
+
+        state.dirty_display = true;
+        rehash_display(state);
+    }
+
+    template <typename State>
+    void scroll_display_left(State& state) {
+        const unsigned int height = display_height(state);
+        for (unsigned int y = 0; y < height; y++) {
+            uint64_t* row = &state.display[y * C8_DISPLAY_ROW_WORDS];
+            row[0] = (row[0] << 4) | (row[1] >> 60);
+            row[1] = row[1] << 4;
+        }
+
+        state.dirty_display = true;
+        rehash_display(state);
+    }
+
+    // Draw the N rows sprite at I (16 x 16 if N = 0) at (x, y), wrapping around the edges of the
+    // display. Return true on collision.
+    template <typename State>
+    bool draw_sprite(State& state, unsigned int x, unsigned int y, unsigned int n, bool clip) {
+        const unsigned int width = display_width(state);
+        const unsigned int height = display_height(state);
+        x %= width;
+        y %= height;
+
+        const bool large = n == 0;
+        const unsigned int nb_rows = large ? 16 : n;
+
+        bool collision = false;
+        state.dirty_display = true;
+
+        for (unsigned int irow = 0; irow < nb_rows && (!clip || y + irow < height); irow++) {
+            uint64_t sprite;
+            if (large) {
+                sprite = (read_memory(state, state.I + 2*irow) << 8) | read_memory(state, state.I + 2*irow + 1);
+            } else {
+                sprite = read_memory(state, state.I + irow);
+            }
+
+            uint64_t words[C8_DISPLAY_ROW_WORDS];
+            place_sprite_row(words, x, sprite, large ? 16 : 8, width, clip);
+
+            const unsigned int index = ((y + irow) % height) * C8_DISPLAY_ROW_WORDS;
+            collision |= words[0] && xor_display_word(state, index, words[0]);
+            collision |= words[1] && xor_display_word(state, index + 1, words[1]);
+        }
+
+        return collision;
+    }
+}
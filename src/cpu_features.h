@@ -0,0 +1,51 @@
+#pragma once
+
+// SIMD kernels selected at run time
+//
+// The AVX2 and AVX-512 kernels are built on any x86 target: without CHIP8_NATIVE_ARCH they are
+// compiled with a target attribute and only called if the CPU supports the instruction set
+// (cpu_has_avx2, cpu_has_avx512bw).
+#if defined(__AVX2__)
+#define C8_AVX2_KERNELS 1
+#define C8_TARGET_AVX2
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define C8_AVX2_KERNELS 1
+#define C8_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(__AVX512BW__)
+#define C8_AVX512_KERNELS 1
+#define C8_TARGET_AVX512BW
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define C8_AVX512_KERNELS 1
+#define C8_TARGET_AVX512BW __attribute__((target("avx512f,avx512bw")))
+#endif
+
+#if defined(C8_AVX2_KERNELS) || defined(C8_AVX512_KERNELS)
+#include <immintrin.h>
+#endif
+
+namespace chip8 {
+
+#if defined(C8_AVX2_KERNELS)
+    inline bool cpu_has_avx2() {
+#if defined(__AVX2__)
+        return true;
+#else
+        static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+        return avx2;
+#endif
+    }
+#endif
+
+#if defined(C8_AVX512_KERNELS)
+    inline bool cpu_has_avx512bw() {
+#if defined(__AVX512BW__)
+        return true;
+#else
+        static const bool avx512bw = (__builtin_cpu_init(), __builtin_cpu_supports("avx512bw"));
+        return avx512bw;
+#endif
+    }
+#endif
+}
@@ -0,0 +1,77 @@
+#include "cycle_detector.h"
+
+namespace chip8 {
+
+    static void restart(CycleDetector& detector, const CHIP8EmulatorState& state, unsigned int nb_cycles) {
+        detector.start = state;
+        detector.start_frame = detector.frame;
+        detector.nb_cycles = nb_cycles;
+
+        detector.saved_hash = hash_state(state);
+        detector.power = 1;
+        detector.lambda = 0;
+
+        detector.found = false;
+        detector.period = 0;
+        detector.entry_frame = 0;
+    }
+
+    // Number of frames from the start before the cycle is entered: run a second state period
+    // frames ahead, then both in step until they meet
+    static uint64_t find_entry(const CycleDetector& detector) {
+        CHIP8EmulatorState tortoise = detector.start;
+        CHIP8EmulatorState hare = detector.start;
+        for (uint64_t i = 0; i < detector.period; i++) {
+            emulate_frame(hare, detector.nb_cycles);
+        }
+
+        uint64_t mu = 0;
+        while (hash_state(tortoise) != hash_state(hare)) {
+            emulate_frame(tortoise, detector.nb_cycles);
+            emulate_frame(hare, detector.nb_cycles);
+            mu += 1;
+        }
+        return mu;
+    }
+
+    CycleDetector create_cycle_detector(const CHIP8EmulatorState& state) {
+        CycleDetector detector;
+        restart(detector, state, 0);
+        return detector;
+    }
+
+    void watch_cycle_input(CycleDetector& detector, const CHIP8EmulatorState& state) {
+        if (state.keypad != detector.start.keypad) {
+            restart(detector, state, detector.nb_cycles);
+        }
+    }
+
+    bool update_cycle_detector(CycleDetector& detector, const CHIP8EmulatorState& state, unsigned int nb_cycles) {
+        if (detector.found) {
+            return true;
+        }
+
+        detector.frame += 1;
+        if (nb_cycles != detector.nb_cycles) {
+            restart(detector, state, nb_cycles);
+            return false;
+        }
+
+        uint64_t hash = hash_state(state);
+        detector.lambda += 1;
+
+        if (hash == detector.saved_hash) {
+            detector.found = true;
+            detector.period = detector.lambda;
+            detector.entry_frame = detector.start_frame + find_entry(detector);
+            return true;
+        }
+
+        if (detector.lambda == detector.power) {
+            detector.saved_hash = hash;
+            detector.power *= 2;
+            detector.lambda = 0;
+        }
+        return false;
+    }
+}
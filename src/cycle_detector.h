@@ -0,0 +1,42 @@
+#pragma once
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    // Detects that an instance running with a constant input came back to a state it was already in
+    //
+    // From there the run is periodic (a 1NNN to itself after a game over, an attract loop): the rest
+    // of the cycle budget can be skipped. Brent's algorithm on the per-frame hash_state needs one
+    // saved hash, and finds the exact period. The entry frame is then found by replaying from the
+    // state saved when the input last changed.
+    //
+    // States are compared through their 64-bit hash only.
+    struct CycleDetector {
+        // State when the detection (re)started, the input is constant since
+        CHIP8EmulatorState start;
+        uint64_t start_frame{};
+        uint64_t frame{};
+        unsigned int nb_cycles{};
+
+        // Brent's tortoise, moved to the hare every power-of-two steps
+        uint64_t saved_hash{};
+        uint64_t power{1};
+        uint64_t lambda{};
+
+        // Result, valid once found
+        bool found{};
+        uint64_t period{};
+        // First frame (counted from the creation of the detector) from which the run repeats
+        uint64_t entry_frame{};
+    };
+
+    CycleDetector create_cycle_detector(const CHIP8EmulatorState& state);
+
+    // Call before each frame: the detection restarts when the keypad changed, a found cycle included
+    // (e.g. a key pressed on a game over screen). It also restarts when the cycles per frame change.
+    void watch_cycle_input(CycleDetector& detector, const CHIP8EmulatorState& state);
+
+    // Call after each frame, return true once the state entered a cycle (and from then on)
+    bool update_cycle_detector(CycleDetector& detector, const CHIP8EmulatorState& state, unsigned int nb_cycles);
+}
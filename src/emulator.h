@@ -1,4 +1,7 @@
+#pragma once
+
 #include <cstdint>
+#include <cstddef>
 #include <string.h>
 #include <algorithm>    // std::copy
 #include <stdlib.h>     /* srand, rand */
@@ -6,6 +9,8 @@
 
 #include <fmt/core.h>
 
+#include "quirks.h"
+
 namespace chip8 {
 
     const unsigned int C8_REGISTER_SIZE = 16;
@@ -15,11 +20,28 @@ namespace chip8 {
     const unsigned int C8_DISPLAY_WIDTH = 64;
     const unsigned int C8_DISPLAY_HEIGHT = 32;
 
+    // SUPER-CHIP high resolution mode (00FF)
+    const unsigned int C8_HIRES_WIDTH = 128;
+    const unsigned int C8_HIRES_HEIGHT = 64;
+    // A display row is 128 bits, pixel x is bit 63 - x % 64 of word x / 64 (MSB first)
+    const unsigned int C8_DISPLAY_ROW_WORDS = C8_HIRES_WIDTH / 64;
+
+    // SUPER-CHIP persistent user flags (FX75/FX85)
+    const unsigned int C8_RPL_FLAGS_SIZE = 8;
+
     const unsigned int C8_FONTSET_SIZE = 80;
     const unsigned int C8_FONT_SIZE = 5;
     const unsigned int C8_FONTSET_START_ADDRESS = 0x50;
+
+    // SUPER-CHIP 8x10 digits (FX30), right after the small font
+    const unsigned int C8_BIGFONT_SIZE = 10;
+    const unsigned int C8_BIGFONTSET_SIZE = 16 * C8_BIGFONT_SIZE;
+    const unsigned int C8_BIGFONTSET_START_ADDRESS = C8_FONTSET_START_ADDRESS + C8_FONTSET_SIZE;
     const unsigned int C8_START_ADDRESS = 0x200;
 
+    // The delay and sound timers count down at 60hz, one tick per emulated frame
+    const unsigned int C8_FRAME_RATE = 60;
+
     const uint8_t C8_FONTSET[C8_FONTSET_SIZE] =
         {
             0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -40,17 +62,123 @@ namespace chip8 {
             0xF0, 0x80, 0xF0, 0x80, 0x80  // F
         };
 
+    const uint8_t C8_BIGFONTSET[C8_BIGFONTSET_SIZE] =
+        {
+            0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+            0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+            0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+            0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+            0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+            0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+            0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+            0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+            0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+            0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+            0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+        };
+
+    const unsigned int C8_CACHE_LINE_SIZE = 64;
+
+    const uint32_t C8_DEFAULT_SEED = 0x2545F491u;
+
+    // Granularity of the memory sharing between snapshots
+    const unsigned int C8_PAGE_SIZE = 256;
+    const unsigned int C8_PAGE_COUNT = C8_MEMORY_SIZE / C8_PAGE_SIZE;
+
+    // Instruction set implemented by a state type, each gets its own interpreter (see interpreter.h)
+    //  * CHIP8: CHIP-8 with the SUPER-CHIP 1.1 extensions (CHIP8EmulatorState)
+    //  * XOCHIP: XO-CHIP (XOCHIPState, xochip.h)
+    //  * MEGACHIP: MEGA-CHIP (MegaChipState, megachip.h)
+    enum class Platform : uint8_t {
+        CHIP8 = 0,
+        XOCHIP = 1,
+        MEGACHIP = 2,
+    };
+
+    inline const char* platform_name(Platform platform) {
+        switch (platform) {
+            case Platform::XOCHIP:   return "XO-CHIP";
+            case Platform::MEGACHIP: return "MEGA-CHIP";
+            default:                 return "CHIP-8";
+        }
+    }
+
     // {} inside struct -> value-initialization -> zero-initialization
 
     // Based on the specification of https://en.wikipedia.org/wiki/CHIP-8
-    // The following specification is based on the SUPER-CHIP specification from 1991 
-    // (but without the additional opcodes that provide extended functionality), as that is the most commonly encountered extension set today
-    struct CHIP8EmulatorState {
-        /////// Memory ///////
+    // The following specification is based on the SUPER-CHIP 1.1 specification from 1991, 
+    // as that is the most commonly encountered extension set today (128x64 mode, scrolling, 16x16 sprites, big font, user flags)
+    //
+    // The fields touched by every instruction (registers, pc, I, timers, keypad, stack) are packed
+    // in the first cache line, before the bulk memory and display arrays. Stepping an instance
+    // therefore touches that line plus the bytes of memory/display the instruction really uses.
+    struct alignas(C8_CACHE_LINE_SIZE) CHIP8EmulatorState {
+        static constexpr Platform platform = Platform::CHIP8;
+        static constexpr unsigned int memory_size = C8_MEMORY_SIZE;
+
+        ////////////////////////////////
+        // Hot: first cache line (64 bytes)
+        ////////////////////////////////
+
+        /////// Registers ///////
         // Register > 16 byte
         //  * Address from V0 to VF
         uint8_t V[C8_REGISTER_SIZE]{};
-        
+
+        //////// Instruction "Index" ///////
+        //Program Counter
+        // * Store the currently executing address
+        uint16_t pc{};
+
+        //Index Register
+        // * Special Register for specific OpCode
+        uint16_t I{};
+
+        //Opcode
+        // * Store the current instruction
+        uint16_t opcode{};
+
+        ////// Keypad ///////
+        // * One bit per key, bit i is set while key i is pressed
+        uint16_t keypad{};
+
+        //Stack Pointer
+        // * Proportional to the number of levels in the stack
+        uint8_t sp{};
+
+        ////// Timers ///////
+        //Delay Timer
+        // * Count down to 0 at 60hz 
+        uint8_t delay_timer{};
+
+        //Sound Timer
+        // * Counter are in MS
+        // * Count down to 0 at 60hz 
+        uint8_t sound_timer{};
+
+        ////// Resolution ///////
+        // * 0: 64 x 32, 1: 128 x 64 (SUPER-CHIP 00FF)
+        uint8_t hires{};
+
+        ////// Random ///////
+        // * xorshift32 state used by CXKK, never 0
+        // * Kept per instance so runs are reproducible from a seed
+        uint32_t rng{C8_DEFAULT_SEED};
+
+        ////// Stack ///////
+        // * Keep track the order of execution
+        alignas(32) uint16_t stack[16]{};
+
+        ////////////////////////////////
+        // Cold: bulk arrays
+        ////////////////////////////////
+
+        /////// Memory ///////
         // Main Memory > 4 KibiByte  (4096 bytes)
         // +---------------+= 0xFFF (4095) End of Chip-8 RAM
         // |               |
@@ -76,44 +204,94 @@ namespace chip8 {
         // +---------------+= 0x000 (0) Start of Chip-8 RAM
         uint8_t memory[C8_MEMORY_SIZE]{};
 
-        //////// Instruction "Index" ///////
-        //Program Counter
-        // * Store the currently executing address
-        uint16_t pc{};
+        ////// Graphics Display ///////
+        // * 1 bit per pixel, one 128-bit row (C8_DISPLAY_ROW_WORDS words) per line
+        // * 128 x 64 pixels in hires mode, only the top-left 64 x 32 pixels are used otherwise
+        uint64_t display[C8_HIRES_HEIGHT * C8_DISPLAY_ROW_WORDS]{};
 
-        //Opcode
-        // * Store the current instruction
-        uint16_t opcode{};
+        ////////////////////////////////
+        // Cold registers and bookkeeping: one cache line, only touched by the instructions
+        // writing memory, display or user flags
+        ////////////////////////////////
 
-        //Index Register
-        // * Special Register for specific OpCode
-        uint16_t I{};
+        // Write tracking, used to share the untouched pages between snapshots
+        // * bit i is set when the memory page i (C8_PAGE_SIZE bytes) has been written
+        alignas(C8_CACHE_LINE_SIZE) uint16_t dirty_pages{};
+        // * set when the display has been written
+        bool dirty_display{};
 
-        ////// Stack ///////
-        // * Keep track the order of execution
-        uint16_t stack[16]{};
-        
-        //Stack Pointer
-        // * Proportional to the number of levels in the stack
-        uint8_t sp{};
+        // Interpreter behaviours of the ROM (see quirks.h), kept by reset_state and load_rom_from_buffer
+        QuirkProfile quirks{};
 
-        ////// Timers ///////
-        //Delay Timer
-        // * Count down to 0 at 60hz 
-        uint8_t delay_timer{};
+        // Incremental hash, maintained by every write to memory or display (see hash_state)
+        // * XOR of the hash of every (address, byte) of memory, 0 bytes hash to 0
+        uint64_t memory_hash{};
+        // * XOR of the hash of every non empty display word, 0 once the display is cleared
+        uint64_t display_hash{};
 
-        //Sound Timer
-        // * Counter are in MS
-        // * Count down to 0 at 60hz 
-        uint8_t sound_timer{};
+        ////// User flags ///////
+        // * SUPER-CHIP RPL flags, saved and loaded by FX75/FX85
+        uint8_t rpl[C8_RPL_FLAGS_SIZE]{};
+    };
 
-        ////// Keypad ///////
-        uint8_t keypad[C8_KEYPAD_SIZE]{};
+    // Layout guards: keep the hot fields within the first cache line and the bulk arrays line-aligned
+    static_assert(offsetof(CHIP8EmulatorState, V) == 0, "V must start the hot cache line");
+    static_assert(offsetof(CHIP8EmulatorState, pc) == 16, "Unexpected hot field layout");
+    static_assert(offsetof(CHIP8EmulatorState, hires) < 28, "Unexpected hot field layout");
+    static_assert(offsetof(CHIP8EmulatorState, stack) + sizeof(CHIP8EmulatorState::stack) == C8_CACHE_LINE_SIZE,
+                  "The hot fields must fit in a single cache line");
+    static_assert(offsetof(CHIP8EmulatorState, memory) == C8_CACHE_LINE_SIZE, "memory must start right after the hot cache line");
+    static_assert(offsetof(CHIP8EmulatorState, display) % C8_CACHE_LINE_SIZE == 0, "display must be cache line aligned");
+    static_assert(offsetof(CHIP8EmulatorState, dirty_pages) == C8_CACHE_LINE_SIZE + C8_MEMORY_SIZE + sizeof(CHIP8EmulatorState::display),
+                  "The bookkeeping line must follow the bulk arrays");
+    static_assert(sizeof(CHIP8EmulatorState) == 2 * C8_CACHE_LINE_SIZE + C8_MEMORY_SIZE + sizeof(CHIP8EmulatorState::display),
+                  "CHIP8EmulatorState must not contain padding besides the hot and bookkeeping cache lines");
+    static_assert(C8_MEMORY_SIZE / C8_PAGE_SIZE <= 16, "dirty_pages holds one bit per page");
 
-        ////// Graphics Display ///////
-        // * 64 x 32 pixels
-        uint8_t display[C8_DISPLAY_WIDTH * C8_DISPLAY_HEIGHT]{};
-    };
+    inline bool is_key_pressed(uint16_t keypad, uint8_t key) {
+        return (keypad >> (key & 0x0Fu)) & 0b1;
+    }
+
+    inline bool is_key_pressed(const CHIP8EmulatorState& state, uint8_t key) {
+        return is_key_pressed(state.keypad, key);
+    }
+
+    inline void set_key(CHIP8EmulatorState& state, uint8_t key, bool pressed) {
+        uint16_t mask = 1u << (key & 0x0Fu);
+        state.keypad = pressed ? (state.keypad | mask) : (state.keypad & ~mask);
+    }
+
+    // True if the next instruction is a jump to itself (the usual way ROMs stop) or 00FD (exit)
+    inline bool is_halted(const CHIP8EmulatorState& state) {
+        uint16_t next = (state.memory[state.pc & (C8_MEMORY_SIZE - 1)] << 8) | state.memory[(state.pc + 1) & (C8_MEMORY_SIZE - 1)];
+        return ((next & 0xF000u) == 0x1000u && (next & 0x0FFFu) == state.pc) || next == 0x00FDu;
+    }
+
+    // Size of the display in the current mode
+    inline unsigned int display_width(const CHIP8EmulatorState& state) {
+        return state.hires ? C8_HIRES_WIDTH : C8_DISPLAY_WIDTH;
+    }
+
+    inline unsigned int display_height(const CHIP8EmulatorState& state) {
+        return state.hires ? C8_HIRES_HEIGHT : C8_DISPLAY_HEIGHT;
+    }
+
+    inline bool get_pixel(const CHIP8EmulatorState& state, unsigned int x, unsigned int y) {
+        uint64_t word = state.display[y * C8_DISPLAY_ROW_WORDS + x / 64];
+        return (word >> (63 - x % 64)) & 0b1;
+    }
+
+    // Flag the memory pages overlapping [address, address + size) as written
+    inline void mark_dirty_pages(CHIP8EmulatorState& state, unsigned int address, unsigned int size) {
+        unsigned int first = address / C8_PAGE_SIZE;
+        unsigned int last = (address + size - 1) / C8_PAGE_SIZE;
+        for (unsigned int page = first; page <= last && page < C8_PAGE_COUNT; page++) {
+            state.dirty_pages |= 1u << page;
+        }
+    }
+
+    // Seed the random generator of CXKK
+    void seed_random(CHIP8EmulatorState& state, uint64_t seed);
 
     CHIP8EmulatorState create_chip8emulator();
 
@@ -121,7 +299,30 @@ namespace chip8 {
 
     void load_rom_from_buffer(CHIP8EmulatorState& state, uint8_t* rom, int size);
 
+    // Hot reload: apply the differences between the ROM image the state was loaded from (old_rom)
+    // and its new version (rom) to the memory, keeping the registers, timers, stack and display.
+    // Bytes the program wrote itself are kept unless the ROM changed them. Returns the bytes written.
+    size_t patch_rom(CHIP8EmulatorState& state, const uint8_t* old_rom, size_t old_size, const uint8_t* rom, size_t size);
+
+    // Execute a single instruction. Timers are left untouched.
     void emulate_cycle(CHIP8EmulatorState& state);
 
+    // Count down the delay and sound timers by one tick (1/60 sec)
+    void update_timers(CHIP8EmulatorState& state);
+
+    // Execute nb_cycles instructions followed by one timer tick
+    // The frame ends early when the program is stalled (waiting for a key in FX0A or jumping
+    // to itself), the result is identical. Return the number of instructions really executed.
+    unsigned int emulate_frame(CHIP8EmulatorState& state, unsigned int nb_cycles);
+
+    // 64-bit hash of everything that determines the future of the machine: registers, stack, timers,
+    // random state, memory, display and quirk profile. The keypad (an input) and the last opcode are left out.
+    // O(1): memory and display come from the incremental hashes, only the hot cache line is hashed.
+    uint64_t hash_state(const CHIP8EmulatorState& state);
+
+    // Recompute memory_hash and display_hash from scratch
+    // Needed after writing memory or display directly instead of through the instructions.
+    void rehash_state(CHIP8EmulatorState& state);
+
     void destroy_chip8emulator(CHIP8EmulatorState& state);
 }
\ No newline at end of file
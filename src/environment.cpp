@@ -0,0 +1,128 @@
+#include "environment.h"
+
+namespace chip8 {
+
+    static float read_reward_value(const CHIP8EmulatorState& state, const RewardSpec& spec) {
+        uint32_t value = 0;
+        for (unsigned int i = 0; i < spec.nb_bytes; i++) {
+            uint8_t byte = state.memory[(spec.address + i) & (C8_MEMORY_SIZE - 1)];
+            value = spec.bcd ? value * 10 + byte : (value << 8) | byte;
+        }
+        return static_cast<float>(value);
+    }
+
+    static bool is_done(const CHIP8EmulatorState& state, const DoneSpec& spec, uint32_t steps) {
+        bool done = false;
+        done |= spec.use_memory && state.memory[spec.address & (C8_MEMORY_SIZE - 1)] == spec.value;
+        done |= spec.on_halt && is_halted(state);
+        done |= spec.max_steps != 0 && steps >= spec.max_steps;
+        return done;
+    }
+
+    static void reset_instance(CHIP8Environment& env, size_t i) {
+        CHIP8EmulatorState& state = env.scheduler.instances[i];
+        state = env.prototype;
+        seed_random(state, env.seed + i * 0x9E3779B97F4A7C15ull + (env.episodes[i] << 32));
+        restart_instance(env.scheduler, i);
+
+        env.reward_values[i] = read_reward_value(state, env.config.reward);
+        env.steps[i] = 0;
+    }
+
+    // Keep one bit out of two of a 128-bit row (hi, lo), each kept bit being the OR of its pair
+    static uint64_t downsample_row(uint64_t hi, uint64_t lo) {
+        uint64_t row = 0;
+        for (unsigned int b = 0; b < 32; b++) {
+            row |= static_cast<uint64_t>(((hi >> (62 - 2 * b)) & 0b11) != 0) << (63 - b);
+            row |= static_cast<uint64_t>(((lo >> (62 - 2 * b)) & 0b11) != 0) << (31 - b);
+        }
+        return row;
+    }
+
+    void pack_observation(const CHIP8EmulatorState& state, uint8_t* observation) {
+        for (unsigned int y = 0; y < C8_DISPLAY_HEIGHT; y++) {
+            uint64_t row;
+            if (state.hires) {
+                const uint64_t* top = &state.display[2 * y * C8_DISPLAY_ROW_WORDS];
+                const uint64_t* bottom = top + C8_DISPLAY_ROW_WORDS;
+                row = downsample_row(top[0] | bottom[0], top[1] | bottom[1]);
+            } else {
+                row = state.display[y * C8_DISPLAY_ROW_WORDS];
+            }
+
+            for (unsigned int b = 0; b < 8; b++) {
+                observation[y * 8 + b] = static_cast<uint8_t>(row >> (56 - 8 * b));
+            }
+        }
+    }
+
+    bool create_environment(CHIP8Environment& env, const EnvironmentConfig& config,
+                            const uint8_t* rom, int size, size_t nb_instances) {
+        if (size <= 0 || size > static_cast<int>(C8_MEMORY_SIZE - C8_START_ADDRESS)) {
+            fmt::println("ROM size is bigger than memory");
+            return false;
+        }
+
+        env.config = config;
+        env.prototype = create_chip8emulator();
+        load_rom_from_buffer(env.prototype, const_cast<uint8_t*>(rom), size);
+
+        if (!create_scheduler(env.scheduler, config.nb_workers, config.cycles_per_frame)) {
+            return false;
+        }
+        env.scheduler.instances.assign(nb_instances, env.prototype);
+
+        env.reward_values.assign(nb_instances, 0.f);
+        env.steps.assign(nb_instances, 0);
+        env.episodes.assign(nb_instances, 0);
+        return true;
+    }
+
+    size_t environment_size(const CHIP8Environment& env) {
+        return env.scheduler.instances.size();
+    }
+
+    void reset_environment(CHIP8Environment& env, uint64_t seed, uint8_t* observations) {
+        env.seed = seed;
+        for (size_t i = 0; i < environment_size(env); i++) {
+            env.episodes[i] = 0;
+            reset_instance(env, i);
+            pack_observation(env.scheduler.instances[i], &observations[i * C8_OBSERVATION_SIZE]);
+        }
+    }
+
+    void step_environment(CHIP8Environment& env, const uint16_t* actions,
+                          uint8_t* observations, float* rewards, uint8_t* dones) {
+        const size_t nb_instances = environment_size(env);
+
+        for (size_t i = 0; i < nb_instances; i++) {
+            env.scheduler.instances[i].keypad = actions[i];
+        }
+
+        run_scheduler_tick(env.scheduler, env.config.frames_per_step);
+
+        for (size_t i = 0; i < nb_instances; i++) {
+            CHIP8EmulatorState& state = env.scheduler.instances[i];
+            env.steps[i] += 1;
+
+            float value = read_reward_value(state, env.config.reward);
+            float reward = env.config.reward.mode == RewardMode::Delta ? value - env.reward_values[i] : value;
+            rewards[i] = reward * env.config.reward.scale;
+            env.reward_values[i] = value;
+
+            bool done = is_done(state, env.config.done, env.steps[i]);
+            dones[i] = done;
+            if (done) {
+                env.episodes[i] += 1;
+                reset_instance(env, i);
+            }
+
+            pack_observation(state, &observations[i * C8_OBSERVATION_SIZE]);
+        }
+    }
+
+    void destroy_environment(CHIP8Environment& env) {
+        destroy_scheduler(env.scheduler);
+        destroy_chip8emulator(env.prototype);
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include "emulator.h"
+#include "scheduler.h"
+
+namespace chip8 {
+
+    // One observation: the 64 x 32 display packed 1 bit per pixel, row major, MSB first
+    // (the 128 x 64 mode is downsampled, a pixel is lit if any of its 2 x 2 block is)
+    const size_t C8_OBSERVATION_SIZE = C8_DISPLAY_WIDTH * C8_DISPLAY_HEIGHT / 8;
+
+    enum class RewardMode : int {
+        // reward = (value after the step - value before the step) * scale
+        Delta = 0,
+        // reward = value after the step * scale
+        Value = 1,
+    };
+
+    // Where the reward signal lives in guest memory
+    //  * nb_bytes == 0 disables the reward (always 0)
+    //  * bcd: the value is stored as one decimal digit per byte (e.g. written by FX33)
+    //  * otherwise the value is read as a big-endian unsigned integer
+    struct RewardSpec {
+        uint16_t address{};
+        uint8_t nb_bytes{};
+        bool bcd{};
+        RewardMode mode{RewardMode::Delta};
+        float scale{1.f};
+    };
+
+    // When an episode ends
+    //  * memory[address] == value (if use_memory)
+    //  * the program stalled in a jump to itself (if on_halt)
+    //  * max_steps steps have been taken (if != 0)
+    struct DoneSpec {
+        bool use_memory{};
+        uint16_t address{};
+        uint8_t value{};
+        bool on_halt{true};
+        uint32_t max_steps{};
+    };
+
+    struct EnvironmentConfig {
+        unsigned int cycles_per_frame{10};
+        // Number of frames emulated per step, the action being held during all of them
+        unsigned int frames_per_step{4};
+        // 0 uses every hardware thread
+        unsigned int nb_workers{};
+
+        RewardSpec reward;
+        DoneSpec done;
+    };
+
+    // Gym style batched environment
+    //
+    // Every buffer is allocated by create_environment, reset and step do not allocate. The caller owns
+    // the contiguous output buffers:
+    //  * observations: nb_instances * C8_OBSERVATION_SIZE bytes
+    //  * rewards: nb_instances floats
+    //  * dones: nb_instances bytes
+    // An instance reaching the end of its episode is reset right away (with the next seed of its own
+    // sequence), its done flag is set and the observation is the first one of the new episode.
+    struct CHIP8Environment {
+        EnvironmentConfig config;
+
+        // ROM and font loaded once, copied on reset
+        CHIP8EmulatorState prototype;
+
+        InstanceScheduler scheduler;
+
+        std::vector<float> reward_values;
+        std::vector<uint32_t> steps;
+        std::vector<uint64_t> episodes;
+        uint64_t seed{};
+    };
+
+    bool create_environment(CHIP8Environment& env, const EnvironmentConfig& config,
+                            const uint8_t* rom, int size, size_t nb_instances);
+
+    size_t environment_size(const CHIP8Environment& env);
+
+    void reset_environment(CHIP8Environment& env, uint64_t seed, uint8_t* observations);
+
+    // actions: one keypad mask per instance, held for the whole step
+    void step_environment(CHIP8Environment& env, const uint16_t* actions,
+                          uint8_t* observations, float* rewards, uint8_t* dones);
+
+    // Pack the display of a state into one observation
+    void pack_observation(const CHIP8EmulatorState& state, uint8_t* observation);
+
+    void destroy_environment(CHIP8Environment& env);
+}
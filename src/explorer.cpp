@@ -0,0 +1,343 @@
+#include "explorer.h"
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <new>
+
+namespace chip8 {
+
+    // Number of frontier states taken at once by a worker
+    const size_t EXPLORER_CHUNK_SIZE = 16;
+
+    static size_t round_up_pow2(size_t n) {
+        size_t p = 1;
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    bool create_visited_set(VisitedSet& set, size_t capacity, size_t bloom_bits, unsigned int bloom_hashes) {
+        set.capacity = capacity;
+        set.size.store(0, std::memory_order_relaxed);
+
+        if (capacity) {
+            // Keep the load factor under 1/2 so probe sequences stay short
+            size_t nb_slots = round_up_pow2(std::max<size_t>(2 * capacity, 16));
+            set.slots.reset(new (std::nothrow) std::atomic<uint64_t>[nb_slots]);
+            if (!set.slots) {
+                return false;
+            }
+            for (size_t i = 0; i < nb_slots; i++) {
+                set.slots[i].store(0, std::memory_order_relaxed);
+            }
+            set.mask = nb_slots - 1;
+        } else if (bloom_bits) {
+            size_t nb_words = round_up_pow2(std::max<size_t>(bloom_bits, 64)) / 64;
+            set.bloom.reset(new (std::nothrow) std::atomic<uint64_t>[nb_words]);
+            if (!set.bloom) {
+                return false;
+            }
+            for (size_t i = 0; i < nb_words; i++) {
+                set.bloom[i].store(0, std::memory_order_relaxed);
+            }
+            set.bloom_mask = nb_words * 64 - 1;
+            set.bloom_hashes = std::max(bloom_hashes, 1u);
+        }
+
+        return set.slots || set.bloom;
+    }
+
+    // 0 marks the empty slots
+    static inline uint64_t to_key(uint64_t hash) {
+        return hash ? hash : 1;
+    }
+
+    // Bloom bit k of a key (double hashing)
+    static inline size_t bloom_bit(const VisitedSet& set, uint64_t key, unsigned int k) {
+        uint64_t step = ((key >> 32) | (key << 32)) | 1;
+        return (key + k * step) & set.bloom_mask;
+    }
+
+    InsertResult insert_visited(VisitedSet& set, uint64_t hash) {
+        const uint64_t key = to_key(hash);
+
+        if (set.bloom) {
+            bool maybe_present = true;
+            for (unsigned int k = 0; k < set.bloom_hashes; k++) {
+                size_t bit = bloom_bit(set, key, k);
+                uint64_t mask = 1ull << (bit & 63);
+                uint64_t old = set.bloom[bit >> 6].fetch_or(mask, std::memory_order_relaxed);
+                maybe_present &= (old & mask) != 0;
+            }
+
+            if (maybe_present) {
+                return InsertResult::Present;
+            }
+            set.size.fetch_add(1, std::memory_order_relaxed);
+            return InsertResult::Inserted;
+        }
+
+        size_t i = key & set.mask;
+        while (true) {
+            uint64_t current = set.slots[i].load(std::memory_order_acquire);
+            if (current == key) {
+                return InsertResult::Present;
+            }
+
+            if (current == 0) {
+                if (set.size.load(std::memory_order_relaxed) >= set.capacity) {
+                    return InsertResult::Full;
+                }
+                if (set.slots[i].compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                    set.size.fetch_add(1, std::memory_order_relaxed);
+                    return InsertResult::Inserted;
+                }
+                // Another thread took the slot, it may have inserted the same key
+                if (current == key) {
+                    return InsertResult::Present;
+                }
+            }
+
+            i = (i + 1) & set.mask;
+        }
+    }
+
+    bool contains_visited(const VisitedSet& set, uint64_t hash) {
+        const uint64_t key = to_key(hash);
+
+        if (set.bloom) {
+            for (unsigned int k = 0; k < set.bloom_hashes; k++) {
+                size_t bit = bloom_bit(set, key, k);
+                if (!((set.bloom[bit >> 6].load(std::memory_order_relaxed) >> (bit & 63)) & 0b1)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        size_t i = key & set.mask;
+        while (true) {
+            uint64_t current = set.slots[i].load(std::memory_order_acquire);
+            if (current == key) {
+                return true;
+            }
+            if (current == 0) {
+                return false;
+            }
+            i = (i + 1) & set.mask;
+        }
+    }
+
+    void destroy_visited_set(VisitedSet& set) {
+        set.slots.reset();
+        set.bloom.reset();
+        set.mask = 0;
+        set.capacity = 0;
+        set.bloom_mask = 0;
+        set.size.store(0, std::memory_order_relaxed);
+    }
+
+    struct ExplorerNode {
+        CHIP8Snapshot snapshot;
+        // Index in the trail
+        uint32_t trail;
+    };
+
+    // How a state was first reached, enough to rebuild the input sequence leading to it
+    struct ExplorerStep {
+        uint32_t parent;
+        uint16_t keypad;
+    };
+
+    struct ExplorerChild {
+        CHIP8Snapshot snapshot;
+        uint32_t parent;
+        uint16_t keypad;
+    };
+
+    // Shared by the workers while expanding one level
+    struct ExplorerLevel {
+        const std::vector<ExplorerNode>* frontier{};
+        unsigned int depth{};
+        std::atomic<size_t> next{0};
+
+        std::atomic<bool> stop{false};
+        std::mutex found_mutex;
+        uint32_t found_parent{};
+        uint16_t found_keypad{};
+
+        std::atomic<uint64_t> transitions{0};
+        std::atomic<uint64_t> duplicates{0};
+        std::atomic<bool> truncated{false};
+    };
+
+    static void expand_level(ExplorerLevel& level, VisitedSet& set, const ExplorerConfig& config,
+                             const std::vector<uint16_t>& inputs, const ExplorerVisitor& visitor,
+                             std::vector<ExplorerChild>& children) {
+        const std::vector<ExplorerNode>& frontier = *level.frontier;
+
+        CHIP8EmulatorState work;
+        // Snapshot the work state currently matches
+        const CHIP8Snapshot* matches = nullptr;
+
+        uint64_t transitions = 0;
+        uint64_t duplicates = 0;
+
+        while (!level.stop.load(std::memory_order_relaxed)) {
+            size_t begin = level.next.fetch_add(EXPLORER_CHUNK_SIZE, std::memory_order_relaxed);
+            if (begin >= frontier.size()) {
+                break;
+            }
+            size_t end = std::min(begin + EXPLORER_CHUNK_SIZE, frontier.size());
+
+            for (size_t i = begin; i < end; i++) {
+                const ExplorerNode& node = frontier[i];
+
+                for (uint16_t input : inputs) {
+                    // Only the pages written by the previous transition are copied back
+                    restore_snapshot(node.snapshot, work, matches);
+                    matches = &node.snapshot;
+
+                    work.keypad = input;
+                    for (unsigned int f = 0; f < config.frames_per_step; f++) {
+                        emulate_frame(work, config.cycles_per_frame);
+                    }
+                    transitions += 1;
+
+                    switch (insert_visited(set, hash_state(work))) {
+                        case InsertResult::Present:
+                            duplicates += 1;
+                            continue;
+                        case InsertResult::Full:
+                            level.truncated.store(true, std::memory_order_relaxed);
+                            continue;
+                        case InsertResult::Inserted:
+                            break;
+                    }
+
+                    if (visitor && visitor(work, level.depth + 1)) {
+                        std::lock_guard<std::mutex> lock(level.found_mutex);
+                        if (!level.stop.load(std::memory_order_relaxed)) {
+                            level.found_parent = node.trail;
+                            level.found_keypad = input;
+                            level.stop.store(true, std::memory_order_relaxed);
+                        }
+                    }
+
+                    children.push_back({capture_snapshot(work, &node.snapshot), node.trail, input});
+                    matches = &children.back().snapshot;
+                }
+            }
+        }
+
+        level.transitions.fetch_add(transitions, std::memory_order_relaxed);
+        level.duplicates.fetch_add(duplicates, std::memory_order_relaxed);
+    }
+
+    ExplorerResult explore_states(const CHIP8EmulatorState& start, const ExplorerConfig& config,
+                                  const ExplorerVisitor& visitor) {
+        auto time_start = std::chrono::steady_clock::now();
+        ExplorerResult result;
+
+        std::vector<uint16_t> inputs = config.inputs;
+        if (inputs.empty()) {
+            inputs.push_back(0);
+            for (unsigned int key = 0; key < C8_KEYPAD_SIZE; key++) {
+                inputs.push_back(1u << key);
+            }
+        }
+
+        unsigned int nb_workers = config.nb_workers ? config.nb_workers : std::thread::hardware_concurrency();
+        nb_workers = std::max(nb_workers, 1u);
+
+        const size_t max_states = std::min<size_t>(config.max_states, UINT32_MAX);
+        // ~0.2% of false positives at the state limit with 4 hashes
+        size_t bloom_bits = config.exact ? 0 : std::max(config.bloom_bits, 32 * max_states);
+
+        VisitedSet set;
+        if (!create_visited_set(set, config.exact ? max_states : 0, bloom_bits)) {
+            fmt::println("Not enough memory for the visited set");
+            return result;
+        }
+
+        CHIP8EmulatorState root = start;
+        insert_visited(set, hash_state(root));
+
+        std::vector<ExplorerStep> trail;
+        trail.push_back({UINT32_MAX, 0});
+
+        std::vector<ExplorerNode> frontier;
+        frontier.push_back({capture_snapshot(root, nullptr), 0});
+
+        bool found = visitor && visitor(root, 0);
+        uint32_t found_parent = UINT32_MAX;
+        uint16_t found_keypad = 0;
+
+        unsigned int depth = 0;
+        while (!found && !frontier.empty() && (config.max_depth == 0 || depth < config.max_depth)) {
+            ExplorerLevel level;
+            level.frontier = &frontier;
+            level.depth = depth;
+
+            size_t nb_chunks = (frontier.size() + EXPLORER_CHUNK_SIZE - 1) / EXPLORER_CHUNK_SIZE;
+            size_t nb_threads = std::min<size_t>(nb_workers, nb_chunks);
+
+            std::vector<std::vector<ExplorerChild>> children(nb_threads);
+            std::vector<std::thread> threads;
+            for (size_t t = 1; t < nb_threads; t++) {
+                threads.emplace_back(expand_level, std::ref(level), std::ref(set), std::cref(config),
+                                     std::cref(inputs), std::cref(visitor), std::ref(children[t]));
+            }
+            expand_level(level, set, config, inputs, visitor, children[0]);
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+
+            result.nb_transitions += level.transitions.load();
+            result.nb_duplicates += level.duplicates.load();
+            result.truncated |= level.truncated.load();
+
+            if (level.stop.load()) {
+                found = true;
+                found_parent = level.found_parent;
+                found_keypad = level.found_keypad;
+            }
+
+            std::vector<ExplorerNode> next;
+            for (std::vector<ExplorerChild>& list : children) {
+                for (ExplorerChild& child : list) {
+                    if (trail.size() >= max_states) {
+                        result.truncated = true;
+                        break;
+                    }
+                    trail.push_back({child.parent, child.keypad});
+                    next.push_back({std::move(child.snapshot), static_cast<uint32_t>(trail.size() - 1)});
+                }
+            }
+
+            frontier = std::move(next);
+            depth += 1;
+        }
+
+        if (found) {
+            result.found = true;
+            if (found_parent != UINT32_MAX) {
+                result.path.push_back(found_keypad);
+                for (uint32_t i = found_parent; trail[i].parent != UINT32_MAX; i = trail[i].parent) {
+                    result.path.push_back(trail[i].keypad);
+                }
+                std::reverse(result.path.begin(), result.path.end());
+            }
+        }
+
+        result.nb_states = trail.size();
+        result.depth = depth;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+
+        destroy_visited_set(set);
+        destroy_chip8emulator(root);
+        return result;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+#include "snapshot.h"
+
+namespace chip8 {
+
+    enum class InsertResult {
+        Inserted,
+        Present,
+        // The table reached its capacity, the state was not recorded
+        Full,
+    };
+
+    // Concurrent set of visited state hashes
+    //
+    // Open addressing with linear probing over atomic 64-bit slots, insertions are lock-free (one CAS
+    // on an empty slot). States are identified by their 64-bit hash only, as in hash compaction:
+    // two states colliding on the full 64 bits are merged.
+    //
+    // With capacity 0 a Bloom filter replaces the table (bitstate hashing): a hash whose bits are not
+    // all set yet is new for sure. The memory stays fixed for state spaces too large for the table, at
+    // the price of a few states wrongly seen as visited.
+    struct VisitedSet {
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+        size_t mask{};
+        size_t capacity{};
+        std::atomic<size_t> size{0};
+
+        std::unique_ptr<std::atomic<uint64_t>[]> bloom;
+        size_t bloom_mask{};
+        unsigned int bloom_hashes{};
+    };
+
+    // bloom_bits is rounded up to a power of two, it is only used (and must not be 0) if capacity is 0
+    bool create_visited_set(VisitedSet& set, size_t capacity, size_t bloom_bits = 0, unsigned int bloom_hashes = 4);
+
+    InsertResult insert_visited(VisitedSet& set, uint64_t hash);
+
+    bool contains_visited(const VisitedSet& set, uint64_t hash);
+
+    void destroy_visited_set(VisitedSet& set);
+
+    struct ExplorerConfig {
+        // One transition = the keypad held for frames_per_step frames of cycles_per_frame
+        unsigned int cycles_per_frame{10};
+        unsigned int frames_per_step{1};
+
+        // Keypad masks tried from every state, empty: no key plus each of the 16 keys alone
+        std::vector<uint16_t> inputs;
+
+        // 0: unlimited
+        unsigned int max_depth{0};
+        size_t max_states{1u << 20};
+
+        // See VisitedSet: exact uses the table, otherwise a Bloom filter of at least bloom_bits
+        size_t bloom_bits{0};
+        bool exact{true};
+
+        // 0 uses every hardware thread
+        unsigned int nb_workers{0};
+    };
+
+    struct ExplorerResult {
+        size_t nb_states{};
+        uint64_t nb_transitions{};
+        uint64_t nb_duplicates{};
+        unsigned int depth{};
+
+        // The visitor asked to stop, path holds the inputs leading to that state from the start
+        bool found{};
+        std::vector<uint16_t> path;
+
+        // The visited set was full, some states were not explored
+        bool truncated{};
+        double seconds{};
+    };
+
+    // Called once per newly reached state with its depth, concurrently from the worker threads.
+    // Return true to stop the exploration (e.g. the puzzle is solved).
+    using ExplorerVisitor = std::function<bool(const CHIP8EmulatorState&, unsigned int)>;
+
+    // Breadth-first search of the states reachable from start under the configured inputs
+    //
+    // Each level of the search is split between the workers. The states of the frontier are kept as
+    // snapshots sharing their unwritten pages with their parent, so a level costs little more than
+    // the pages the ROM really writes.
+    ExplorerResult explore_states(const CHIP8EmulatorState& start, const ExplorerConfig& config,
+                                  const ExplorerVisitor& visitor = {});
+}
@@ -0,0 +1,127 @@
+#include "frame_cache.h"
+
+namespace chip8 {
+
+    static_assert(sizeof(FrameDelta::hot) == offsetof(CHIP8EmulatorState, memory),
+                  "The delta stores exactly the hot cache line of the state");
+
+    bool create_frame_cache(FrameCache& cache, size_t nb_entries) {
+        size_t size = 1;
+        while (size < nb_entries) {
+            size <<= 1;
+        }
+
+        cache.entries.clear();
+        cache.entries.resize(size);
+        cache.mask = size - 1;
+        cache.stats = {};
+        return true;
+    }
+
+    static uint64_t frame_key(const CHIP8EmulatorState& state, unsigned int nb_cycles) {
+        uint64_t key = hash_state(state);
+        key ^= (static_cast<uint64_t>(state.keypad) + 1) * 0x9E3779B97F4A7C15ull;
+        key ^= (static_cast<uint64_t>(nb_cycles) << 17) * 0xC2B2AE3D27D4EB4Full;
+        key ^= key >> 29;
+        return key ? key : 1;
+    }
+
+    static void replay(const FrameDelta& delta, CHIP8EmulatorState& state) {
+        memcpy(static_cast<void*>(&state), delta.hot, sizeof(delta.hot));
+
+        for (const MemoryWrite& write : delta.memory) {
+            state.memory[write.address] = write.value;
+            state.dirty_pages |= 1u << (write.address / C8_PAGE_SIZE);
+        }
+
+        for (const DisplayWrite& write : delta.display) {
+            state.display[write.index] ^= write.mask;
+        }
+        state.dirty_display |= !delta.display.empty();
+
+        state.memory_hash = delta.memory_hash;
+        state.display_hash = delta.display_hash;
+        memcpy(state.rpl, delta.rpl, sizeof(state.rpl));
+    }
+
+    static void record(FrameDelta& delta, const CHIP8EmulatorState& before, const CHIP8EmulatorState& after) {
+        memcpy(delta.hot, &after, sizeof(delta.hot));
+
+        // Only the pages flagged by the frame can differ
+        delta.memory.clear();
+        for (unsigned int page = 0; page < C8_PAGE_COUNT; page++) {
+            if (!((after.dirty_pages >> page) & 0b1)) {
+                continue;
+            }
+            for (unsigned int address = page * C8_PAGE_SIZE; address < (page + 1) * C8_PAGE_SIZE; address++) {
+                if (before.memory[address] != after.memory[address]) {
+                    delta.memory.push_back({static_cast<uint16_t>(address), after.memory[address]});
+                }
+            }
+        }
+
+        delta.display.clear();
+        if (after.dirty_display) {
+            for (unsigned int index = 0; index < C8_HIRES_HEIGHT * C8_DISPLAY_ROW_WORDS; index++) {
+                uint64_t mask = before.display[index] ^ after.display[index];
+                if (mask) {
+                    delta.display.push_back({static_cast<uint16_t>(index), mask});
+                }
+            }
+        }
+
+        delta.memory_hash = after.memory_hash;
+        delta.display_hash = after.display_hash;
+        memcpy(delta.rpl, after.rpl, sizeof(delta.rpl));
+    }
+
+    unsigned int emulate_frame_cached(FrameCache& cache, CHIP8EmulatorState& state, unsigned int nb_cycles) {
+        const uint64_t key = frame_key(state, nb_cycles);
+        FrameDelta& delta = cache.entries[key & cache.mask];
+
+        if (delta.key == key) {
+            replay(delta, state);
+            cache.stats.hits += 1;
+            cache.stats.cycles_saved += delta.cycles;
+            return delta.cycles;
+        }
+
+        cache.stats.misses += 1;
+        cache.stats.evictions += delta.key != 0;
+
+        // Track the writes of this frame alone, the previous flags are merged back afterwards
+        uint16_t dirty_pages = state.dirty_pages;
+        bool dirty_display = state.dirty_display;
+        state.dirty_pages = 0;
+        state.dirty_display = false;
+        cache.before = state;
+
+        unsigned int cycles = emulate_frame(state, nb_cycles);
+
+        delta.key = key;
+        delta.cycles = cycles;
+        record(delta, cache.before, state);
+
+        state.dirty_pages |= dirty_pages;
+        state.dirty_display |= dirty_display;
+        return cycles;
+    }
+
+    double frame_cache_hit_rate(const FrameCacheStats& stats) {
+        uint64_t lookups = stats.hits + stats.misses;
+        return lookups ? static_cast<double>(stats.hits) / lookups : 0.0;
+    }
+
+    void clear_frame_cache(FrameCache& cache) {
+        for (FrameDelta& delta : cache.entries) {
+            delta.key = 0;
+        }
+        cache.stats = {};
+    }
+
+    void destroy_frame_cache(FrameCache& cache) {
+        cache.entries.clear();
+        cache.entries.shrink_to_fit();
+        cache.mask = 0;
+    }
+}
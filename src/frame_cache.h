@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    struct MemoryWrite {
+        uint16_t address;
+        uint8_t value;
+    };
+
+    // Pixels toggled in one display word
+    struct DisplayWrite {
+        uint16_t index;
+        uint64_t mask;
+    };
+
+    // Effect of one frame on a given state
+    struct FrameDelta {
+        // 0: empty entry
+        uint64_t key{};
+
+        // Hot cache line after the frame (registers, stack, timers, random state, resolution)
+        alignas(C8_CACHE_LINE_SIZE) uint8_t hot[C8_CACHE_LINE_SIZE]{};
+
+        // Memory bytes changed and pixels toggled by the frame
+        std::vector<MemoryWrite> memory;
+        std::vector<DisplayWrite> display;
+
+        uint64_t memory_hash{};
+        uint64_t display_hash{};
+        uint8_t rpl[C8_RPL_FLAGS_SIZE]{};
+
+        unsigned int cycles{};
+    };
+
+    struct FrameCacheStats {
+        uint64_t hits{};
+        uint64_t misses{};
+        // Entries replaced by another state mapping to the same slot
+        uint64_t evictions{};
+        // Instructions not executed thanks to the hits
+        uint64_t cycles_saved{};
+    };
+
+    // Memoization of whole frames
+    //
+    // Title screens, attract loops and idle gameplay go through the exact same states with the same
+    // input again and again. The cache maps (hash_state, keypad, nb_cycles) at a frame boundary to
+    // the delta the frame produced, so a repeated frame is a delta application instead of hundreds
+    // of instructions. States are identified by their 64-bit hash only.
+    //
+    // Direct mapped: a new delta replaces the one in its slot. A cache is not thread safe, use one
+    // per thread.
+    struct FrameCache {
+        std::vector<FrameDelta> entries;
+        size_t mask{};
+
+        FrameCacheStats stats;
+
+        // Copy of the state before the frame being recorded
+        CHIP8EmulatorState before;
+    };
+
+    // nb_entries is rounded up to a power of two
+    bool create_frame_cache(FrameCache& cache, size_t nb_entries);
+
+    // Same result as emulate_frame, replayed from the cache when the frame was already seen
+    unsigned int emulate_frame_cached(FrameCache& cache, CHIP8EmulatorState& state, unsigned int nb_cycles);
+
+    double frame_cache_hit_rate(const FrameCacheStats& stats);
+
+    void clear_frame_cache(FrameCache& cache);
+
+    void destroy_frame_cache(FrameCache& cache);
+}
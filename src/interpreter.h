@@ -0,0 +1,1028 @@
+#pragma once
+
+#include "emulator.h"
+#include "xochip.h"
+#include "megachip.h"
+#include "cpu_features.h"
+
+// Instruction set shared by the state types (CHIP8EmulatorState, XOCHIPState, MegaChipState)
+//
+// The handlers are templates on the state: every state type gets its own interpreter, so a plain
+// CHIP-8 instance keeps its small state and pays no check for extensions it does not have. The
+// instructions of a single platform are selected with if constexpr on State::platform.
+//
+// The handlers of the instructions with quirks (see quirks.h) are also templates on the quirk
+// profile: interpret_cycle and interpret_frame pick the interpreter of the profile of the state
+// once per call, the handlers then test compile-time constants.
+//
+// A state type provides:
+//  * the hot fields of CHIP8EmulatorState (V to stack, stack last), memory, memory_hash, rpl and quirks
+//  * static constexpr platform and memory_size (a power of two)
+//  * write_memory, clear_display, set_resolution, scroll_display_down/right/left and draw_sprite,
+//    found by argument dependent lookup when the interpreter is instantiated
+//
+// Only include from the translation unit implementing a state type (emulator.cpp, xochip.cpp, megachip.cpp).
+
+namespace chip8 {
+
+    // Hash of a byte at a location of the incremental hashes (Zobrist style)
+    // Locations: memory addresses, then memory_size + word index for the display
+    inline uint64_t location_hash(unsigned int location, uint8_t value) {
+        uint64_t x = ((static_cast<uint64_t>(location) << 8) | value) * 0x9E3779B97F4A7C15ull;
+        x ^= x >> 32;
+        x *= 0xD6E8FEB86659FD93ull;
+        x ^= x >> 32;
+        return value ? x : 0;
+    }
+
+    // Hash of a display word at a location of the display hash, 0 words hash to 0
+    inline uint64_t location_word_hash(unsigned int location, uint64_t word) {
+        uint64_t x = word + location * 0x9E3779B97F4A7C15ull;
+        x ^= x >> 31;
+        x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 29;
+        x *= 0x94D049BB133111EBull;
+        x ^= x >> 32;
+        return word ? x : 0;
+    }
+
+    // xorshift32 state of CXKK for a seed, never 0
+    inline uint32_t random_state_from_seed(uint64_t seed) {
+        // splitmix64 finalizer, so close seeds give unrelated sequences
+        seed += 0x9E3779B97F4A7C15ull;
+        seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ull;
+        seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBull;
+        seed = seed ^ (seed >> 31);
+
+        uint32_t rng = static_cast<uint32_t>(seed ^ (seed >> 32));
+        return rng ? rng : C8_DEFAULT_SEED;
+    }
+
+    inline uint64_t rotate_right(uint64_t x, unsigned int n) {
+        return n ? (x >> n) | (x << (64 - n)) : x;
+    }
+
+    // Place a sprite row of width bits (MSB first in the low width bits of row) at x in a 128-bit
+    // display row, wrapping around the right edge of the row_width pixels of the current mode, or
+    // dropping the pixels past it if clip is set
+    inline void place_sprite_row(uint64_t words[2], unsigned int x, uint64_t row, unsigned int width, unsigned int row_width,
+                                 bool clip) {
+        if (clip) {
+            uint64_t aligned = row << (64 - width);
+            uint64_t head = aligned >> (x % 64);
+            uint64_t tail = x % 64 ? aligned << (64 - x % 64) : 0;
+            words[0] = x < 64 ? head : 0;
+            words[1] = x < 64 ? (row_width > 64 ? tail : 0) : head;
+            return;
+        }
+
+        uint64_t left = rotate_right(row << (64 - width), x % 64);
+        if (row_width == 64) {
+            words[0] = left;
+            words[1] = 0;
+            return;
+        }
+
+        // 128-bit rotation: the bits rotated out of one word enter the other
+        uint64_t spill = width + x % 64 > 64 ? left & ~(~0ull >> (x % 64)) : 0;
+        words[0] = left ^ spill;
+        words[1] = spill;
+        if (x >= 64) {
+            std::swap(words[0], words[1]);
+        }
+    }
+
+    template <typename State>
+    inline uint8_t read_memory(const State& state, unsigned int address) {
+        return state.memory[address & (State::memory_size - 1)];
+    }
+
+    // Skip the following instruction if condition is true
+    // On XO-CHIP the 4 bytes long F000 NNNN is skipped as a whole
+    template <typename State>
+    inline void skip_instruction(State& state, bool condition) {
+        if constexpr (State::platform == Platform::XOCHIP) {
+            if (condition) {
+                bool long_load = read_memory(state, state.pc) == 0xF0u && read_memory(state, state.pc + 1) == 0x00u;
+                state.pc += long_load ? 4 : 2;
+            }
+        } else {
+            state.pc += 2 * condition;
+        }
+    }
+
+    ///////////////////////
+    // OPCODE
+    ///////////////////////
+
+    template <typename State>
+    void OP_NULL(State& state) {
+        fmt::println("Wrong OPCODE Call: {}", state.opcode);
+    }
+
+    // Clear the display (the selected planes on XO-CHIP)
+    template <typename State>
+    void OP_00E0(State& state) {
+        clear_display(state);
+    }
+
+    // Scroll the display down by N lines
+    template <typename State>
+    void OP_00CN(State& state) {
+        scroll_display_down(state, state.opcode & 0x000Fu);
+    }
+
+    // Scroll the display up by N lines (XO-CHIP)
+    template <typename State>
+    void OP_00DN(State& state) {
+        if constexpr (State::platform == Platform::XOCHIP) {
+            scroll_display_up(state, state.opcode & 0x000Fu);
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Scroll the display up by N lines (MEGA-CHIP)
+    template <typename State>
+    void OP_00BN(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            scroll_display_up(state, state.opcode & 0x000Fu);
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Leave (0010) or enter (0011) the 256 x 192 MEGA-CHIP mode, the display is cleared
+    template <typename State>
+    void OP_001N(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            switch (state.opcode & 0x000Fu) {
+                case 0x0u: state.hires = 0; clear_display(state); break;
+                case 0x1u: state.hires = MC_MEGA_MODE; clear_display(state); break;
+                default: OP_NULL(state); break;
+            }
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Load the 24-bit address NN followed by the 16 bits stored after the instruction in register I (MEGA-CHIP)
+    template <typename State>
+    void OP_01NN(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            uint32_t NN = state.opcode & 0x00FFu;
+            state.I = (NN << 16) | (read_memory(state, state.pc) << 8) | read_memory(state, state.pc + 1);
+            state.pc += 2;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Load NN colours (4 bytes each: alpha, red, green, blue) from I in the palette entries 1 to NN (MEGA-CHIP)
+    template <typename State>
+    void OP_02NN(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            unsigned int NN = state.opcode & 0x00FFu;
+            for (unsigned int i = 0; i < NN; i++) {
+                uint32_t colour = 0;
+                for (unsigned int b = 0; b < 4; b++) {
+                    colour = (colour << 8) | read_memory(state, state.I + 4 * i + b);
+                }
+                state.palette[(i + 1) & 0xFFu] = colour;
+            }
+            state.dirty_display = true;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Set the sprite width to NN, 0 is 256 (MEGA-CHIP)
+    template <typename State>
+    void OP_03NN(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            state.sprite_width = state.opcode & 0x00FFu;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Set the sprite height to NN, 0 is 256 (MEGA-CHIP)
+    template <typename State>
+    void OP_04NN(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            state.sprite_height = state.opcode & 0x00FFu;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Set the alpha of the whole screen to NN (MEGA-CHIP)
+    template <typename State>
+    void OP_05NN(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            state.screen_alpha = state.opcode & 0x00FFu;
+            state.dirty_display = true;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Play the digitised sound at I, in a loop if N is 0 (MEGA-CHIP)
+    template <typename State>
+    void OP_060N(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            state.sound_address = state.I;
+            state.sound_loop = (state.opcode & 0x000Fu) == 0;
+            state.sound_playing = true;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Stop the digitised sound (MEGA-CHIP)
+    template <typename State>
+    void OP_0700(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            state.sound_playing = false;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Set the sprite blend mode to N (MEGA-CHIP, see MegaChipBlend)
+    template <typename State>
+    void OP_080N(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            uint8_t N = state.opcode & 0x000Fu;
+            state.blend_mode = N <= static_cast<uint8_t>(MegaChipBlend::Multiply) ? N : 0;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Set the collision colour to the palette index NN (MEGA-CHIP)
+    template <typename State>
+    void OP_09NN(State& state) {
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            state.collision_colour = state.opcode & 0x00FFu;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Scroll the display right by 4 pixels
+    template <typename State>
+    void OP_00FB(State& state) {
+        scroll_display_right(state);
+    }
+
+    // Scroll the display left by 4 pixels
+    template <typename State>
+    void OP_00FC(State& state) {
+        scroll_display_left(state);
+    }
+
+    // Exit the interpreter: the instruction repeats forever
+    template <typename State>
+    void OP_00FD(State& state) {
+        state.pc -= 2;
+    }
+
+    // Switch to the 64 x 32 mode, the display is cleared
+    template <typename State>
+    void OP_00FE(State& state) {
+        set_resolution(state, false);
+    }
+
+    // Switch to the 128 x 64 mode, the display is cleared
+    template <typename State>
+    void OP_00FF(State& state) {
+        set_resolution(state, true);
+    }
+
+    // Return from a subroutine
+    template <typename State>
+    void OP_00EE(State& state) {
+        state.sp -= 1;
+        state.pc = state.stack[state.sp];
+    }
+
+    // Jump to address NNN
+    template <typename State>
+    void OP_1NNN(State& state) {
+        uint16_t NNN = (state.opcode & 0x0FFFu);
+        state.pc = NNN;
+    }
+
+    // Call subroutine at NNN
+    template <typename State>
+    void OP_2NNN(State& state) {
+        uint16_t NNN = (state.opcode & 0x0FFFu);
+
+        state.stack[state.sp] = state.pc;
+        state.sp += 1;
+        state.pc = NNN;
+    }
+
+    // Skip the following instruction if the value of register VX equals NN
+    template <typename State>
+    void OP_3XKK(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t KK = (state.opcode & 0x00FFu);
+
+        skip_instruction(state, state.V[X] == KK);
+    }
+
+    // Skip the following instruction if the value of register VX is not equal to NN
+    template <typename State>
+    void OP_4XKK(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t KK = (state.opcode & 0x00FFu);
+
+        skip_instruction(state, state.V[X] != KK);
+    }
+
+    // Skip the following instruction if the value of register VX is equal to the value of register VY
+    template <typename State>
+    void OP_5XY0(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        skip_instruction(state, state.V[X] == state.V[Y]);
+    }
+
+    // Store VX to VY (in that order, VX > VY included) in memory, starting at address I (XO-CHIP)
+    // I itself is left unmodified
+    template <typename State>
+    void OP_5XY2(State& state) {
+        if constexpr (State::platform == Platform::XOCHIP) {
+            uint8_t X = (state.opcode & 0x0F00u) >> 8;
+            uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+            int step = X <= Y ? 1 : -1;
+            unsigned int count = (X <= Y ? Y - X : X - Y) + 1;
+            for (unsigned int i = 0; i < count; i++) {
+                write_memory(state, state.I + i, state.V[X + step * static_cast<int>(i)]);
+            }
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Load VX to VY (in that order, VX > VY included) from memory, starting at address I (XO-CHIP)
+    // I itself is left unmodified
+    template <typename State>
+    void OP_5XY3(State& state) {
+        if constexpr (State::platform == Platform::XOCHIP) {
+            uint8_t X = (state.opcode & 0x0F00u) >> 8;
+            uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+            int step = X <= Y ? 1 : -1;
+            unsigned int count = (X <= Y ? Y - X : X - Y) + 1;
+            for (unsigned int i = 0; i < count; i++) {
+                state.V[X + step * static_cast<int>(i)] = read_memory(state, state.I + i);
+            }
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Store number KK in register VX
+    template <typename State>
+    void OP_6XKK(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t KK = (state.opcode & 0x00FFu);
+
+        state.V[X] = KK;
+    }
+
+    template <typename State>
+    void OP_7XKK(State& state) {
+        // Add the value KK to register VX
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t KK = state.opcode & 0x00FFu;
+
+        state.V[X] +=  KK;
+    }
+
+    // Store the value of register VY in register VX
+    template <typename State>
+    void OP_8XY0(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        state.V[X] = state.V[Y];
+    }
+
+    // Set VX to VX OR VY (and VF to 0 with the logic_resets_vf quirk)
+    template <typename State, QuirkProfile Profile>
+    void OP_8XY1(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        state.V[X] = state.V[X] | state.V[Y];
+        if constexpr (quirk_set(Profile).logic_resets_vf) {
+            state.V[0xF] = 0;
+        }
+    }
+
+    // Set VX to VX AND VY (and VF to 0 with the logic_resets_vf quirk)
+    template <typename State, QuirkProfile Profile>
+    void OP_8XY2(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        state.V[X] = state.V[X] & state.V[Y];
+        if constexpr (quirk_set(Profile).logic_resets_vf) {
+            state.V[0xF] = 0;
+        }
+    }
+
+    template <typename State, QuirkProfile Profile>
+    void OP_8XY3(State& state) {
+        // Set VX to VX XOR VY (and VF to 0 with the logic_resets_vf quirk)
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        state.V[X] = state.V[X] ^ state.V[Y];
+        if constexpr (quirk_set(Profile).logic_resets_vf) {
+            state.V[0xF] = 0;
+        }
+    }
+
+    // Vx = Vx + Vy
+    // Set VF to 01 if a carry occurs
+    // Set VF to 00 if a carry does not occur
+    template <typename State>
+    void OP_8XY4(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        uint16_t sum = state.V[X] + state.V[Y];
+        uint8_t carry = sum > 0x00FFu;
+
+        state.V[0x0F] = carry;
+        state.V[X] = sum;
+    }
+
+    // Vx = Vx - Vy.
+    // VF is set to 0 when there's a borrow, and 1 when there is not.
+    template <typename State>
+    void OP_8XY5(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        uint16_t sub = state.V[X] - state.V[Y];
+        uint8_t noborrow = state.V[X] > state.V[Y];
+
+        state.V[0x0F] = noborrow;
+        state.V[X] = sub;
+    }
+
+    // Stores the least significant bit of VX in VF and then shifts VX to the right by 1.
+    // With the shift_uses_vy quirk, VY is shifted into VX instead.
+    template <typename State, QuirkProfile Profile>
+    void OP_8XY6(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        uint8_t source = quirk_set(Profile).shift_uses_vy ? state.V[Y] : state.V[X];
+        uint8_t lsb = (source & 0b00000001u);
+        state.V[0xF] = lsb;
+        state.V[X] = source >> 1;
+    }
+
+    // Vx = Vy - Vx.
+    // VF is set to 0 when there's a borrow, and 1 when there is not.
+    template <typename State>
+    void OP_8XY7(State& state) {
+        //TODO
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        uint16_t sub = state.V[Y] - state.V[X];
+        uint8_t noborrow = state.V[Y] > state.V[X];
+
+        state.V[0x0F] = noborrow;
+        state.V[X] = sub;
+    }
+
+    // Stores the most significant bit of VX in VF and then shifts VX to the left by 1.
+    // With the shift_uses_vy quirk, VY is shifted into VX instead.
+    template <typename State, QuirkProfile Profile>
+    void OP_8XYE(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        uint8_t source = quirk_set(Profile).shift_uses_vy ? state.V[Y] : state.V[X];
+        uint8_t msb = (source & 0x80u) >> 7;
+        state.V[0xF] = msb;
+        state.V[X] = source << 1;
+    }
+
+    // Skip the following instruction if the value of register VX is not equal to the value of register VY
+    template <typename State>
+    void OP_9XY0(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+
+        skip_instruction(state, state.V[X] != state.V[Y]);
+    }
+
+    // Store memory address NNN in register I
+    template <typename State>
+    void OP_ANNN(State& state) {
+        uint16_t NNN = state.opcode & 0x0FFFu;
+        state.I = NNN;
+    }
+
+    // Jump to address NNN + V0
+    // With the jump_uses_vx quirk (BXNN), jump to XNN + VX instead
+    template <typename State, QuirkProfile Profile>
+    void OP_BNNN(State& state) {
+        uint16_t NNN = state.opcode & 0x0FFFu;
+        uint8_t X = quirk_set(Profile).jump_uses_vx ? (state.opcode & 0x0F00u) >> 8 : 0;
+        state.pc = state.V[X] + NNN;
+    }
+
+    // Set VX to a random number with a mask of NN
+    template <typename State>
+    void OP_CXKK(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t NN = (state.opcode & 0x00FFu);
+
+        // xorshift32
+        uint32_t x = state.rng;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        state.rng = x;
+
+        state.V[X] = (x >> 24) & NN;
+    }
+
+    // Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels.
+    // Each row of 8 pixels is read as bit-coded starting from memory location I;
+    // I value does not change after the execution of this instruction.
+    // As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that does not happen
+    // DXY0 draws a 16 x 16 sprite (2 bytes per row) instead
+    // The sprites wrap around the edges of the display, unless the clip_sprites quirk is set
+    template <typename State, QuirkProfile Profile>
+    void OP_DXYN(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        uint8_t Y = (state.opcode & 0x00F0u) >> 4;
+        uint8_t N = (state.opcode & 0x000Fu);
+
+        state.V[0xF] = draw_sprite(state, state.V[X], state.V[Y], N, quirk_set(Profile).clip_sprites);
+    }
+
+    // Skip the following instruction if the key corresponding to the hex value currently stored in register VX is pressed
+    template <typename State>
+    void OP_EX9E(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+
+        skip_instruction(state, is_key_pressed(state.keypad, state.V[X]));
+    }
+
+    // Skip the following instruction if the key corresponding to the hex value currently stored in register VX is not pressed
+    template <typename State>
+    void OP_EXA1(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+
+        skip_instruction(state, !is_key_pressed(state.keypad, state.V[X]));
+    }
+
+    // Load the 16-bit address stored after the instruction in register I (XO-CHIP)
+    template <typename State>
+    void OP_F000(State& state) {
+        if constexpr (State::platform == Platform::XOCHIP) {
+            state.I = (read_memory(state, state.pc) << 8) | read_memory(state, state.pc + 1);
+            state.pc += 2;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Select the drawing planes N (bit mask, FN01) used by DXYN, 00E0 and the scrolls (XO-CHIP)
+    template <typename State>
+    void OP_FN01(State& state) {
+        if constexpr (State::platform == Platform::XOCHIP) {
+            state.planes = ((state.opcode & 0x0F00u) >> 8) & 0b11u;
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Load the 16 bytes audio pattern from memory, starting at address I (XO-CHIP)
+    template <typename State>
+    void OP_F002(State& state) {
+        if constexpr (State::platform == Platform::XOCHIP) {
+            for (unsigned int i = 0; i < sizeof(state.audio_pattern); i++) {
+                state.audio_pattern[i] = read_memory(state, state.I + i);
+            }
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Store the current value of the delay timer in register VX
+    template <typename State>
+    void OP_FX07(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+
+        state.V[X] = state.delay_timer;
+    }
+
+    // Wait for a keypress and store the result in register VX
+    template <typename State>
+    void OP_FX0A(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+
+        // Highest pressed key, repeat the instruction if none
+        if (state.keypad) {
+            state.V[X] = 31 - __builtin_clz(state.keypad);
+        } else {
+            state.pc -= 2;
+        }
+    }
+
+    // Set the delay timer to the value of register VX
+    template <typename State>
+    void OP_FX15(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        state.delay_timer = state.V[X];
+    }
+
+    // Set the sound timer to the value of register VX
+    template <typename State>
+    void OP_FX18(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+
+        state.sound_timer = state.V[X];
+    }
+
+    // Add the value stored in register VX to register I
+    template <typename State>
+    void OP_FX1E(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+
+        state.I = state.I + state.V[X];
+    }
+
+    // Sets I to the location of the sprite for the character in VX.
+    template <typename State>
+    void OP_FX29(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+
+        state.I = C8_FONTSET_START_ADDRESS + C8_FONT_SIZE * state.V[X];
+    }
+
+    // Sets I to the location of the 8x10 sprite for the digit in VX.
+    template <typename State>
+    void OP_FX30(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+
+        state.I = C8_BIGFONTSET_START_ADDRESS + C8_BIGFONT_SIZE * (state.V[X] & 0x0Fu);
+    }
+
+    // Store the binary-coded decimal equivalent of the value stored in register VX at addresses I, I+1, and I+2
+    template <typename State>
+    void OP_FX33(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+
+        uint8_t rem = state.V[X];
+
+        for (int i = 2; i >= 0; i -= 1) {
+            write_memory(state, state.I+i, rem % 10);
+            rem = rem / 10;
+        }
+    }
+
+    // Set the pitch of the audio pattern playback to VX (XO-CHIP)
+    template <typename State>
+    void OP_FX3A(State& state) {
+        if constexpr (State::platform == Platform::XOCHIP) {
+            uint8_t X = (state.opcode & 0x0F00u) >> 8;
+
+            state.pitch = state.V[X];
+        } else {
+            OP_NULL(state);
+        }
+    }
+
+    // Stores from V0 to VX (including VX) in memory, starting at address I.
+    // The offset from I is increased by 1 for each value written, but I itself is left unmodified
+    // unless the load_store_increments_i quirk is set (I ends at I + X + 1)
+    template <typename State, QuirkProfile Profile>
+    void OP_FX55(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u ) >> 8;
+        for (unsigned int i = 0; i <= X; i++) {
+            write_memory(state, state.I+i, state.V[i]);
+        }
+        if constexpr (quirk_set(Profile).load_store_increments_i) {
+            state.I = state.I + X + 1;
+        }
+    }
+
+    // Fills from V0 to VX (including VX) in memory, starting at address I.
+    // The offset from I is increased by 1 for each value written, but I itself is left unmodified
+    // unless the load_store_increments_i quirk is set (I ends at I + X + 1)
+    template <typename State, QuirkProfile Profile>
+    void OP_FX65(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        for (unsigned int i = 0; i <= X; i++) {
+            state.V[i] = read_memory(state, state.I+i);
+        }
+        if constexpr (quirk_set(Profile).load_store_increments_i) {
+            state.I = state.I + X + 1;
+        }
+    }
+
+    // Store V0 to VX in the user flags (X < 8 on SUPER-CHIP, every register on XO-CHIP)
+    template <typename State>
+    void OP_FX75(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        memcpy(state.rpl, state.V, std::min<unsigned int>(X + 1, sizeof(state.rpl)));
+    }
+
+    // Load V0 to VX from the user flags (X < 8 on SUPER-CHIP, every register on XO-CHIP)
+    template <typename State>
+    void OP_FX85(State& state) {
+        uint8_t X = (state.opcode & 0x0F00u) >> 8;
+        memcpy(state.V, state.rpl, std::min<unsigned int>(X + 1, sizeof(state.rpl)));
+    }
+
+    template <typename State>
+    using Chip8Func = void (*)(State& state);
+
+    // MEGA-CHIP 01NN to 09NN
+    template <typename State>
+    void TB_0NTT(State& state) {
+        using S = State;
+        const static Chip8Func<State> table0N[0xF + 1] = { &OP_NULL<S>, &OP_01NN<S>, &OP_02NN<S>, &OP_03NN<S>,
+                                                           &OP_04NN<S>, &OP_05NN<S>, &OP_060N<S>, &OP_0700<S>,
+                                                           &OP_080N<S>, &OP_09NN<S>, &OP_NULL<S>, &OP_NULL<S>,
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>};
+
+        uint8_t inst_type = (state.opcode & 0x0F00u) >> 8;
+        (*table0N[inst_type])(state);
+    }
+
+    template <typename State>
+    void TB_0TTT(State& state) {
+        const static Chip8Func<State> table0E[0xE + 1] = {&OP_00E0<State>, &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, // 0xE0-0xE3
+                                                          &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, // 0xE4-0xE7
+                                                          &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, // 0xE8-0xEB
+                                                          &OP_NULL<State>, &OP_NULL<State>, &OP_00EE<State>};                 // 0xEC-0xEE
+
+        const static Chip8Func<State> table0F[0xF + 1] = {&OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, // 0xF0-0xF3
+                                                          &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, // 0xF4-0xF7
+                                                          &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, &OP_00FB<State>, // 0xF8-0xFB
+                                                          &OP_00FC<State>, &OP_00FD<State>, &OP_00FE<State>, &OP_00FF<State>};// 0xFC-0xFF
+
+        if constexpr (State::platform == Platform::MEGACHIP) {
+            if (state.opcode & 0x0F00u) {
+                TB_0NTT(state);
+                return;
+            }
+        }
+
+        uint8_t inst_type = (state.opcode & 0x000F);
+        switch (state.opcode & 0x0FF0u) {
+            case 0x0010u: OP_001N(state); break;
+            case 0x00B0u: OP_00BN(state); break;
+            case 0x00C0u: OP_00CN(state); break;
+            case 0x00D0u: OP_00DN(state); break;
+            case 0x00E0u: (*(inst_type <= 0xE ? table0E[inst_type] : &OP_NULL<State>))(state); break;
+            case 0x00F0u: (*table0F[inst_type])(state); break;
+            default: OP_NULL(state); break;
+        }
+    }
+
+    // 5XY0 ignores the low nibble on CHIP-8, XO-CHIP uses it for 5XY2/5XY3
+    template <typename State>
+    void TB_5TTT(State& state) {
+        if constexpr (State::platform == Platform::XOCHIP) {
+            switch (state.opcode & 0x000Fu) {
+                case 0x0u: OP_5XY0(state); break;
+                case 0x2u: OP_5XY2(state); break;
+                case 0x3u: OP_5XY3(state); break;
+                default: OP_NULL(state); break;
+            }
+        } else {
+            OP_5XY0(state);
+        }
+    }
+
+    template <typename State, QuirkProfile Profile>
+    void TB_8TTT(State& state) {
+        using S = State;
+        constexpr QuirkProfile P = Profile;
+        const static Chip8Func<State> table8[0xE + 1] = {&OP_8XY0<S>, &OP_8XY1<S, P>, &OP_8XY2<S, P>, &OP_8XY3<S, P>, // 0x00-0x03
+                                                         &OP_8XY4<S>, &OP_8XY5<S>, &OP_8XY6<S, P>, &OP_8XY7<S>,       // 0x04-0x07
+                                                         &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>,          // 0x08-0x0B
+                                                         &OP_NULL<S>, &OP_NULL<S>, &OP_8XYE<S, P>};                   // 0x0C-0x0E
+
+        uint8_t inst_type = (state.opcode & 0x000F);
+        (*table8[inst_type])(state);
+    }
+
+    template <typename State>
+    void TB_ETTT(State& state) {
+        const static Chip8Func<State> tableE[0xE + 1] = {&OP_NULL<State>, &OP_EXA1<State>, &OP_NULL<State>, &OP_NULL<State>,
+                                                         &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>,
+                                                         &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>, &OP_NULL<State>,
+                                                         &OP_NULL<State>, &OP_NULL<State>, &OP_EX9E<State>};
+
+        uint8_t inst_type = (state.opcode & 0x000F);
+        (*tableE[inst_type])(state);
+    }
+
+    template <typename State, QuirkProfile Profile>
+    void TB_FTTT(State& state) {
+        using S = State;
+        constexpr QuirkProfile P = Profile;
+        const static Chip8Func<State> tableF[0x85 + 1] = { &OP_F000<S>, &OP_FN01<S>, &OP_F002<S>, &OP_NULL<S>, // 0x00-0x03
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_FX07<S>, // 0x04-0x07
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_FX0A<S>, &OP_NULL<S>, // 0x08-0x0B
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x0C-0x0F
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x10-0x13
+                                                           &OP_NULL<S>, &OP_FX15<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x14-0x17
+                                                           &OP_FX18<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x18-0x1B
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_FX1E<S>, &OP_NULL<S>, // 0x1C-0x1F
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x20-0x23
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x24-0x27
+                                                           &OP_NULL<S>, &OP_FX29<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x28-0x2B
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x2C-0x2F
+                                                           &OP_FX30<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_FX33<S>, // 0x30-0x33
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x34-0x37
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_FX3A<S>, &OP_NULL<S>, // 0x38-0x3B
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x3C-0x3F
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x40-0x43
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x44-0x47
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x48-0x4B
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x4C-0x4F
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x50-0x53
+                                                           &OP_NULL<S>, &OP_FX55<S, P>, &OP_NULL<S>, &OP_NULL<S>, // 0x54-0x57
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x58-0x5B
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x5C-0x5F
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x60-0x63
+                                                           &OP_NULL<S>, &OP_FX65<S, P>, &OP_NULL<S>, &OP_NULL<S>, // 0x64-0x67
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x68-0x6B
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x6C-0x6F
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x70-0x73
+                                                           &OP_NULL<S>, &OP_FX75<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x74-0x77
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x78-0x7B
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x7C-0x7F
+                                                           &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, &OP_NULL<S>, // 0x80-0x83
+                                                           &OP_NULL<S>, &OP_FX85<S>};                          // 0x84-0x85
+
+        uint8_t inst_type = (state.opcode & 0x00FF);
+        (*(inst_type <= 0x85 ? tableF[inst_type] : &OP_NULL<State>))(state);
+    }
+
+    // Interpreter of a quirk profile, see interpret_cycle
+    template <typename State, QuirkProfile Profile>
+    void execute_cycle(State& state) {
+        using S = State;
+        constexpr QuirkProfile P = Profile;
+        const static Chip8Func<State> table[0xF + 1] = { &TB_0TTT<S>, &OP_1NNN<S>, &OP_2NNN<S>, &OP_3XKK<S>,
+                                                         &OP_4XKK<S>, &TB_5TTT<S>, &OP_6XKK<S>, &OP_7XKK<S>,
+                                                         &TB_8TTT<S, P>, &OP_9XY0<S>, &OP_ANNN<S>, &OP_BNNN<S, P>,
+                                                         &OP_CXKK<S>, &OP_DXYN<S, P>, &TB_ETTT<S>, &TB_FTTT<S, P>};
+
+        // Fetch the OPCode
+        state.opcode = (read_memory(state, state.pc) << 8) | read_memory(state, state.pc + 1);
+
+        // Increase the program counter
+        state.pc += 2;
+
+        // Call the function
+        uint8_t inst_type = (state.opcode & 0xF000u) >> 12;
+        (*table[inst_type])(state);
+    }
+
+    template <typename State>
+    void interpret_timers(State& state) {
+        if (state.delay_timer > 0) {
+            state.delay_timer -= 1;
+        }
+
+        if (state.sound_timer > 0) {
+            state.sound_timer -= 1;
+        }
+    }
+
+    // True if the instruction just executed from address pc left the state untouched and will
+    // keep doing so until the keypad or the timers change:
+    //  * FX0A waiting for a key
+    //  * 1NNN jumping to itself (typical "halt" at the end of a game)
+    //  * 00FD (exit)
+    template <typename State>
+    bool is_stalled(const State& state, uint16_t pc) {
+        bool waiting_key = (state.opcode & 0xF0FFu) == 0xF00Au && !state.keypad;
+        bool jump_to_self = (state.opcode & 0xF000u) == 0x1000u;
+        bool exited = state.opcode == 0x00FDu;
+        return state.pc == pc && (waiting_key || jump_to_self || exited);
+    }
+
+    // Frame of a quirk profile, see interpret_frame
+    template <typename State, QuirkProfile Profile>
+    unsigned int execute_frame(State& state, unsigned int nb_cycles) {
+        unsigned int i = 0;
+        while (i < nb_cycles) {
+            uint16_t pc = state.pc;
+            execute_cycle<State, Profile>(state);
+            i += 1;
+
+            // The remaining cycles of the frame would leave the state untouched
+            if (is_stalled(state, pc)) {
+                break;
+            }
+        }
+        interpret_timers(state);
+        return i;
+    }
+
+    // Execute a single instruction with the quirk profile of the state
+    template <typename State>
+    void interpret_cycle(State& state) {
+        using S = State;
+        const static Chip8Func<State> cycles[C8_QUIRK_PROFILE_COUNT] = {&execute_cycle<S, QuirkProfile::Default>,
+                                                                        &execute_cycle<S, QuirkProfile::Chip8>,
+                                                                        &execute_cycle<S, QuirkProfile::SuperChip>,
+                                                                        &execute_cycle<S, QuirkProfile::XOChip>};
+
+        (*cycles[static_cast<uint8_t>(state.quirks) % C8_QUIRK_PROFILE_COUNT])(state);
+    }
+
+    // Execute a frame (see emulate_frame) with the quirk profile of the state, selected once per frame
+    template <typename State>
+    unsigned int interpret_frame(State& state, unsigned int nb_cycles) {
+        using S = State;
+        using FrameFunc = unsigned int (*)(State& state, unsigned int nb_cycles);
+        const static FrameFunc frames[C8_QUIRK_PROFILE_COUNT] = {&execute_frame<S, QuirkProfile::Default>,
+                                                                 &execute_frame<S, QuirkProfile::Chip8>,
+                                                                 &execute_frame<S, QuirkProfile::SuperChip>,
+                                                                 &execute_frame<S, QuirkProfile::XOChip>};
+
+        return (*frames[static_cast<uint8_t>(state.quirks) % C8_QUIRK_PROFILE_COUNT])(state, nb_cycles);
+    }
+
+    inline uint64_t mix_word(uint64_t h, uint64_t word) {
+        h ^= word * 0x9E3779B97F4A7C15ull;
+        h = (h << 31) | (h >> 33);
+        return h * 0xC2B2AE3D27D4EB4Full;
+    }
+
+    // size must be a multiple of 8
+    inline uint64_t hash_bytes(uint64_t h, const uint8_t* bytes, size_t size) {
+        for (size_t i = 0; i < size; i += 8) {
+            uint64_t word;
+            memcpy(&word, &bytes[i], sizeof(word));
+            h = mix_word(h, word);
+        }
+        return h;
+    }
+
+    // Hash of the hot fields (opcode and keypad left out), the rest is added by the state type
+    template <typename State>
+    uint64_t hash_hot_line(const State& state) {
+        constexpr size_t size = offsetof(State, stack) + sizeof(State::stack);
+        uint8_t hot[(size + 7) / 8 * 8]{};
+        memcpy(hot, &state, size);
+        memset(&hot[offsetof(State, opcode)], 0, sizeof(state.opcode));
+        memset(&hot[offsetof(State, keypad)], 0, sizeof(state.keypad));
+
+        uint64_t h = 0x243F6A8885A308D3ull;
+        return hash_bytes(h, hot, sizeof(hot));
+    }
+
+    // splitmix64 finalizer
+    inline uint64_t finalize_hash(uint64_t h) {
+        h ^= h >> 30;
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 27;
+        h *= 0x94D049BB133111EBull;
+        return h ^ (h >> 31);
+    }
+
+    // Write the bytes of the ROM image rom that differ from old_rom (the image the state was loaded
+    // from) through write_memory, leaving the registers, display and the other bytes as they are
+    // Returns the number of bytes written.
+    template <typename State>
+    size_t patch_rom_image(State& state, const uint8_t* old_rom, size_t old_size, const uint8_t* rom, size_t size) {
+        const size_t capacity = State::memory_size - C8_START_ADDRESS;
+        size_t end = std::min(std::max(old_size, size), capacity);
+        size_t changed = 0;
+        for (size_t i = 0; i < end; i++) {
+            uint8_t before = i < old_size ? old_rom[i] : 0;
+            uint8_t after = i < size ? rom[i] : 0;
+            if (before != after) {
+                write_memory(state, C8_START_ADDRESS + static_cast<unsigned int>(i), after);
+                changed += 1;
+            }
+        }
+        return changed;
+    }
+}
@@ -1,11 +1,34 @@
 // #define STB_IMAGE_IMPLEMENTATION
 // #include "stb_image.h"
 
+#include <cstring>
+
 #include "app.h"
 
+// Headless: index the ROMs under directory, only running the new and modified ones
+static int index_library(const char* directory, const char* index) {
+    chip8::RomLibrary library;
+    chip8::load_rom_library(library, index);
+
+    chip8::RomLibraryStats stats = chip8::index_rom_library(library, directory);
+    fmt::println("{} indexed, {} unchanged, {} removed, {} failed in {:.2f}s",
+                 stats.indexed, stats.unchanged, stats.removed, stats.failed, stats.seconds);
+
+    if (!chip8::save_rom_library(library, index)) {
+        fmt::println("Cannot write the index {}", index);
+        return 1;
+    }
+    return 0;
+}
+
 
 int main(int argc, char** argv) {
 
+    // CHIP8 --index <directory> [index file]
+    if (argc > 2 && strcmp(argv[1], "--index") == 0) {
+        return index_library(argv[2], argc > 3 ? argv[3] : chip8::LIB_DEFAULT_INDEX);
+    }
+
     chip8::App app;
 
     if (!chip8::create_app(app)) {
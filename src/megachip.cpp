@@ -0,0 +1,445 @@
+#include "megachip.h"
+#include "interpreter.h"
+
+namespace chip8 {
+
+    // XOR of the location hashes of memory[begin, end)
+    static uint64_t memory_range_hash(const MegaChipState& state, unsigned int begin, unsigned int end) {
+        // Most of the 16 MiB is empty, and 0 bytes hash to 0
+        uint64_t hash = 0;
+        for (unsigned int address = begin; address < end; address++) {
+            if (state.memory[address]) {
+                hash ^= location_hash(address, state.memory[address]);
+            }
+        }
+        return hash;
+    }
+
+    // Hash of the indices and colours of the display line y
+    static uint64_t line_hash(const MegaChipState& state, unsigned int y) {
+        uint64_t h = mix_word(0x13198A2E03707344ull, y);
+        h = hash_bytes(h, &state.indices[y * MC_DISPLAY_WIDTH], MC_DISPLAY_WIDTH);
+        return hash_bytes(h, reinterpret_cast<const uint8_t*>(&state.colours[y * MC_DISPLAY_WIDTH]),
+                          MC_DISPLAY_WIDTH * sizeof(uint32_t));
+    }
+
+    // Update the display hash after writing the lines [begin, end)
+    static void rehash_lines(MegaChipState& state, unsigned int begin, unsigned int end) {
+        for (unsigned int y = begin; y < end; y++) {
+            uint64_t h = line_hash(state, y);
+            state.display_hash ^= state.line_hashes[y] ^ h;
+            state.line_hashes[y] = h;
+        }
+    }
+
+    static void rehash_display(MegaChipState& state) {
+        state.display_hash = 0;
+        for (unsigned int y = 0; y < MC_DISPLAY_HEIGHT; y++) {
+            state.line_hashes[y] = line_hash(state, y);
+            state.display_hash ^= state.line_hashes[y];
+        }
+    }
+
+    void create_megachip(MegaChipState& state) {
+        // Built in place: a MegaChipState{} temporary would not fit on the stack
+        memset(state.memory, 0, C8_START_ADDRESS);
+        for(unsigned int i = 0; i < C8_FONTSET_SIZE; i+=1) {
+            state.memory[C8_FONTSET_START_ADDRESS + i] = C8_FONTSET[i];
+        }
+        for(unsigned int i = 0; i < C8_BIGFONTSET_SIZE; i+=1) {
+            state.memory[C8_BIGFONTSET_START_ADDRESS + i] = C8_BIGFONTSET[i];
+        }
+        // Hashes the fonts along with the rest of the memory
+        reset_state(state);
+        state.rng = C8_DEFAULT_SEED;
+        state.keypad = 0;
+        state.quirks = QuirkProfile::SuperChip;
+    }
+
+    void seed_random(MegaChipState& state, uint64_t seed) {
+        state.rng = random_state_from_seed(seed);
+    }
+
+    void reset_state(MegaChipState& state) {
+        memset(state.V, 0, sizeof(state.V));
+        memset(&state.memory[C8_START_ADDRESS], 0, MC_MEMORY_SIZE - C8_START_ADDRESS);
+        state.pc = C8_START_ADDRESS;
+        state.opcode = 0;
+        state.I = 0;
+
+        state.sp = 0;
+        memset(state.stack, 0, sizeof(state.stack));
+
+        state.delay_timer = 0;
+        state.sound_timer = 0;
+
+        state.hires = 0;
+        state.blend_mode = 0;
+        state.collision_colour = 0;
+        state.sprite_width = 0;
+        state.sprite_height = 0;
+        state.screen_alpha = 0xFF;
+        state.sound_address = 0;
+        state.sound_playing = false;
+        state.sound_loop = false;
+        memset(state.rpl, 0, sizeof(state.rpl));
+
+        memset(state.palette, 0, sizeof(state.palette));
+        memset(state.indices, 0, sizeof(state.indices));
+        memset(state.colours, 0, sizeof(state.colours));
+        rehash_display(state);
+
+        state.dirty_display = true;
+        // Everything past the interpreter area was just cleared, only the area is left to hash
+        state.memory_hash = memory_range_hash(state, 0, C8_START_ADDRESS);
+    }
+
+    void load_rom_from_buffer(MegaChipState& state, uint8_t* rom, int size) {
+        reset_state(state);
+        size = std::min<int>(size, MC_MEMORY_SIZE - C8_START_ADDRESS);
+        std::copy(rom, rom + size, state.memory + C8_START_ADDRESS);
+        // The ROM lands on cleared memory, its bytes are added to the hash of the interpreter area
+        state.memory_hash ^= memory_range_hash(state, C8_START_ADDRESS, C8_START_ADDRESS + size);
+    }
+
+    void destroy_megachip(MegaChipState& state) {
+        // Nothing to do here
+    }
+
+    ///////////////////////
+    // BLEND KERNELS
+    ///////////////////////
+
+    // Weight of the sprite colour out of 256
+    static inline unsigned int blend_weight(uint32_t colour, MegaChipBlend mode) {
+        switch (mode) {
+            case MegaChipBlend::Alpha25: return 64;
+            case MegaChipBlend::Alpha50: return 128;
+            case MegaChipBlend::Alpha75: return 192;
+            default: {
+                unsigned int alpha = colour >> 24;
+                return alpha + (alpha >> 7);
+            }
+        }
+    }
+
+    static inline uint32_t blend_colour(uint32_t dst, uint32_t src, MegaChipBlend mode) {
+        const unsigned int w = blend_weight(src, mode);
+
+        uint32_t out = 0;
+        for (unsigned int shift = 0; shift < 24; shift += 8) {
+            unsigned int s = (src >> shift) & 0xFFu;
+            unsigned int d = (dst >> shift) & 0xFFu;
+            unsigned int c;
+            switch (mode) {
+                case MegaChipBlend::Add: c = std::min(s + d, 0xFFu); break;
+                case MegaChipBlend::Multiply: c = (s * d + 0xFFu) >> 8; break;
+                default: c = (s * w + d * (256 - w)) >> 8; break;
+            }
+            out |= c << shift;
+        }
+        return out | 0xFF000000u;
+    }
+
+#if defined(C8_AVX2_KERNELS)
+    // Vector part of blend_indices, return the number of pixels done
+    C8_TARGET_AVX2 static unsigned int blend_indices_avx2(uint8_t* dst, const uint8_t* src, unsigned int n, uint8_t collision_colour, bool& collision) {
+        unsigned int i = 0;
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i target = _mm256_set1_epi8(static_cast<char>(collision_colour));
+        __m256i hits = zero;
+        for (; i + 32 <= n; i += 32) {
+            __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            __m256i transparent = _mm256_cmpeq_epi8(s, zero);
+            __m256i covered = _mm256_andnot_si256(_mm256_cmpeq_epi8(d, zero), _mm256_cmpeq_epi8(d, target));
+            hits = _mm256_or_si256(hits, _mm256_andnot_si256(transparent, covered));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_blendv_epi8(s, d, transparent));
+        }
+        collision = !_mm256_testz_si256(hits, hits);
+        return i;
+    }
+#endif
+
+    // dst[i] = src[i] where src[i] is not transparent (0), for the n pixels of a line
+    // Return true if a drawn pixel covers the collision colour (the empty index 0 never collides)
+    static bool blend_indices(uint8_t* dst, const uint8_t* src, unsigned int n, uint8_t collision_colour) {
+        unsigned int i = 0;
+        bool collision = false;
+#if defined(C8_AVX2_KERNELS)
+        if (cpu_has_avx2()) {
+            i = blend_indices_avx2(dst, src, n, collision_colour, collision);
+        }
+#endif
+        for (; i < n; i++) {
+            collision |= src[i] && dst[i] && dst[i] == collision_colour;
+            dst[i] = src[i] ? src[i] : dst[i];
+        }
+        return collision;
+    }
+
+#if defined(C8_AVX2_KERNELS)
+    // Vector part of blend_colours, return the number of pixels done
+    C8_TARGET_AVX2 static unsigned int blend_colours_avx2(uint32_t* dst, const uint32_t* src, const uint8_t* index, unsigned int n, MegaChipBlend mode) {
+        unsigned int i = 0;
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i opaque = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+        const __m256i full = _mm256_set1_epi16(256);
+        const __m256i round = _mm256_set1_epi16(0xFF);
+        const __m256i constant_weight = _mm256_set1_epi32(static_cast<int>(blend_weight(0, mode)));
+
+        for (; i + 8 <= n; i += 8) {
+            __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+
+            __m256i out;
+            if (mode == MegaChipBlend::Add) {
+                out = _mm256_adds_epu8(s, d);
+            } else {
+                // One 16-bit lane per channel, 2 pixels per 128-bit lane and half
+                __m256i s_lo = _mm256_unpacklo_epi8(s, zero);
+                __m256i s_hi = _mm256_unpackhi_epi8(s, zero);
+                __m256i d_lo = _mm256_unpacklo_epi8(d, zero);
+                __m256i d_hi = _mm256_unpackhi_epi8(d, zero);
+
+                __m256i lo, hi;
+                if (mode == MegaChipBlend::Multiply) {
+                    lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(s_lo, d_lo), round), 8);
+                    hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(s_hi, d_hi), round), 8);
+                } else {
+                    __m256i w = constant_weight;
+                    if (mode == MegaChipBlend::Normal) {
+                        __m256i alpha = _mm256_srli_epi32(s, 24);
+                        w = _mm256_add_epi32(alpha, _mm256_srli_epi32(alpha, 7));
+                    }
+                    // Weight of each pixel in its 4 channel lanes
+                    w = _mm256_or_si256(w, _mm256_slli_epi32(w, 16));
+                    __m256i w_lo = _mm256_unpacklo_epi32(w, w);
+                    __m256i w_hi = _mm256_unpackhi_epi32(w, w);
+
+                    lo = _mm256_add_epi16(_mm256_mullo_epi16(s_lo, w_lo), _mm256_mullo_epi16(d_lo, _mm256_sub_epi16(full, w_lo)));
+                    hi = _mm256_add_epi16(_mm256_mullo_epi16(s_hi, w_hi), _mm256_mullo_epi16(d_hi, _mm256_sub_epi16(full, w_hi)));
+                    lo = _mm256_srli_epi16(lo, 8);
+                    hi = _mm256_srli_epi16(hi, 8);
+                }
+                out = _mm256_packus_epi16(lo, hi);
+            }
+            out = _mm256_or_si256(out, opaque);
+
+            __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(index + i)));
+            __m256i transparent = _mm256_cmpeq_epi32(indices, zero);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_blendv_epi8(out, d, transparent));
+        }
+        return i;
+    }
+#endif
+
+    // dst[i] = blend(dst[i], src[i]) where the palette index of the pixel is not transparent (0)
+    static void blend_colours(uint32_t* dst, const uint32_t* src, const uint8_t* index, unsigned int n, MegaChipBlend mode) {
+        unsigned int i = 0;
+#if defined(C8_AVX2_KERNELS)
+        if (cpu_has_avx2()) {
+            i = blend_colours_avx2(dst, src, index, n, mode);
+        }
+#endif
+        for (; i < n; i++) {
+            dst[i] = index[i] ? blend_colour(dst[i], src[i], mode) : dst[i];
+        }
+    }
+
+    // Move the lines of a buffer of MC_DISPLAY_WIDTH pixels per line by n, the lines entering are empty
+    template <typename T>
+    static void scroll_lines(T* buffer, unsigned int height, unsigned int n, bool down) {
+        n = std::min(n, height);
+        const size_t line = MC_DISPLAY_WIDTH * sizeof(T);
+        if (down) {
+            memmove(&buffer[n * MC_DISPLAY_WIDTH], buffer, (height - n) * line);
+            memset(buffer, 0, n * line);
+        } else {
+            memmove(buffer, &buffer[n * MC_DISPLAY_WIDTH], (height - n) * line);
+            memset(&buffer[(height - n) * MC_DISPLAY_WIDTH], 0, n * line);
+        }
+    }
+
+    // Move the first width pixels of every line by 4, the pixels entering are empty
+    template <typename T>
+    static void scroll_columns(T* buffer, unsigned int width, unsigned int height, bool right) {
+        for (unsigned int y = 0; y < height; y++) {
+            T* line = &buffer[y * MC_DISPLAY_WIDTH];
+            if (right) {
+                memmove(&line[4], line, (width - 4) * sizeof(T));
+                memset(line, 0, 4 * sizeof(T));
+            } else {
+                memmove(line, &line[4], (width - 4) * sizeof(T));
+                memset(&line[width - 4], 0, 4 * sizeof(T));
+            }
+        }
+    }
+
+    ///////////////////////
+    // STATE ACCESS (see interpreter.h)
+    ///////////////////////
+
+    static inline void write_memory(MegaChipState& state, unsigned int address, uint8_t value) {
+        address &= MC_MEMORY_SIZE - 1;
+        state.memory_hash ^= location_hash(address, state.memory[address]) ^ location_hash(address, value);
+        state.memory[address] = value;
+    }
+
+    static void clear_display(MegaChipState& state) {
+        memset(state.indices, 0, sizeof(state.indices));
+        memset(state.colours, 0, sizeof(state.colours));
+        rehash_display(state);
+        state.dirty_display = true;
+    }
+
+    static void set_resolution(MegaChipState& state, bool hires) {
+        state.hires = hires;
+        clear_display(state);
+    }
+
+    static void scroll_display_down(MegaChipState& state, unsigned int n) {
+        scroll_lines(state.indices, display_height(state), n, true);
+        scroll_lines(state.colours, display_height(state), n, true);
+        rehash_lines(state, 0, display_height(state));
+        state.dirty_display = true;
+    }
+
+    static void scroll_display_up(MegaChipState& state, unsigned int n) {
+        scroll_lines(state.indices, display_height(state), n, false);
+        scroll_lines(state.colours, display_height(state), n, false);
+        rehash_lines(state, 0, display_height(state));
+        state.dirty_display = true;
+    }
+
+    static void scroll_display_right(MegaChipState& state) {
+        scroll_columns(state.indices, display_width(state), display_height(state), true);
+        scroll_columns(state.colours, display_width(state), display_height(state), true);
+        rehash_lines(state, 0, display_height(state));
+        state.dirty_display = true;
+    }
+
+    static void scroll_display_left(MegaChipState& state) {
+        scroll_columns(state.indices, display_width(state), display_height(state), false);
+        scroll_columns(state.colours, display_width(state), display_height(state), false);
+        rehash_lines(state, 0, display_height(state));
+        state.dirty_display = true;
+    }
+
+    // SUPER-CHIP modes: 1 bit per pixel XORed in the indices, wrapping around the edges or clipped by them
+    static bool draw_sprite_bits(MegaChipState& state, unsigned int x, unsigned int y, unsigned int n, bool clip) {
+        const unsigned int width = display_width(state);
+        const unsigned int height = display_height(state);
+        x %= width;
+        y %= height;
+
+        const bool large = n == 0;
+        const unsigned int nb_rows = large ? 16 : n;
+        const unsigned int nb_columns = large ? 16 : 8;
+
+        bool collision = false;
+        for (unsigned int irow = 0; irow < nb_rows && (!clip || y + irow < height); irow++) {
+            unsigned int sprite;
+            if (large) {
+                sprite = (read_memory(state, state.I + 2*irow) << 8) | read_memory(state, state.I + 2*irow + 1);
+            } else {
+                sprite = read_memory(state, state.I + irow);
+            }
+
+            const unsigned int line_y = (y + irow) % height;
+            uint8_t* line = &state.indices[line_y * MC_DISPLAY_WIDTH];
+            for (unsigned int column = 0; column < nb_columns && (!clip || x + column < width); column++) {
+                uint8_t bit = (sprite >> (nb_columns - 1 - column)) & 0b1;
+                uint8_t& pixel = line[(x + column) % width];
+                collision |= bit && pixel;
+                pixel ^= bit;
+            }
+            rehash_lines(state, line_y, line_y + 1);
+        }
+        return collision;
+    }
+
+    // MEGA-CHIP mode: sprite_width x sprite_height palette indices at I, blended over the screen
+    // with blend_mode and always clipped at the edges. N is ignored.
+    static bool draw_sprite(MegaChipState& state, unsigned int x, unsigned int y, unsigned int n, bool clip) {
+        state.dirty_display = true;
+        if (state.hires != MC_MEGA_MODE) {
+            return draw_sprite_bits(state, x, y, n, clip);
+        }
+
+        const unsigned int width = state.sprite_width ? state.sprite_width : 256;
+        const unsigned int height = state.sprite_height ? state.sprite_height : 256;
+        const unsigned int visible = x < MC_DISPLAY_WIDTH ? std::min(width, MC_DISPLAY_WIDTH - x) : 0;
+        const MegaChipBlend mode = static_cast<MegaChipBlend>(state.blend_mode);
+
+        alignas(32) uint8_t sprite[MC_DISPLAY_WIDTH];
+        alignas(32) uint32_t colours[MC_DISPLAY_WIDTH];
+
+        bool collision = false;
+        for (unsigned int irow = 0; irow < height && y + irow < MC_DISPLAY_HEIGHT; irow++) {
+            const unsigned int address = state.I + irow * width;
+            if (address + visible <= MC_MEMORY_SIZE) {
+                memcpy(sprite, &state.memory[address], visible);
+            } else {
+                for (unsigned int column = 0; column < visible; column++) {
+                    sprite[column] = read_memory(state, address + column);
+                }
+            }
+            for (unsigned int column = 0; column < visible; column++) {
+                colours[column] = state.palette[sprite[column]];
+            }
+
+            const unsigned int at = (y + irow) * MC_DISPLAY_WIDTH + x;
+            collision |= blend_indices(&state.indices[at], sprite, visible, state.collision_colour);
+            blend_colours(&state.colours[at], colours, sprite, visible, mode);
+            if (visible) {
+                rehash_lines(state, y + irow, y + irow + 1);
+            }
+        }
+        return collision;
+    }
+
+    ///////////////////////
+    // INTERPRETER
+    ///////////////////////
+
+    size_t patch_rom(MegaChipState& state, const uint8_t* old_rom, size_t old_size, const uint8_t* rom, size_t size) {
+        return patch_rom_image(state, old_rom, old_size, rom, size);
+    }
+
+    void emulate_cycle(MegaChipState& state) {
+        interpret_cycle(state);
+    }
+
+    void update_timers(MegaChipState& state) {
+        interpret_timers(state);
+    }
+
+    unsigned int emulate_frame(MegaChipState& state, unsigned int nb_cycles) {
+        return interpret_frame(state, nb_cycles);
+    }
+
+    uint64_t hash_state(const MegaChipState& state) {
+        // Cold registers: sprite size, screen alpha, sound, quirk profile and user flags
+        uint8_t cold[24]{};
+        cold[0] = state.sprite_width;
+        cold[1] = state.sprite_height;
+        cold[2] = state.screen_alpha;
+        cold[3] = state.sound_playing;
+        cold[4] = state.sound_loop;
+        cold[5] = static_cast<uint8_t>(state.quirks);
+        memcpy(&cold[8], &state.sound_address, sizeof(state.sound_address));
+        memcpy(&cold[16], state.rpl, sizeof(state.rpl));
+
+        uint64_t h = hash_hot_line(state);
+        h = hash_bytes(h, cold, sizeof(cold));
+        h = hash_bytes(h, reinterpret_cast<const uint8_t*>(state.palette), sizeof(state.palette));
+        h ^= state.memory_hash ^ state.display_hash;
+        return finalize_hash(h);
+    }
+
+    void rehash_state(MegaChipState& state) {
+        state.memory_hash = memory_range_hash(state, 0, MC_MEMORY_SIZE);
+        rehash_display(state);
+    }
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    // MEGA-CHIP (Revival Studios) extensions of SUPER-CHIP: a 256 x 192 mode with 256 colours
+    // palettes and alpha-blended sprites of any size, 24-bit addresses (01NN NNNN) for large ROMs
+    // and digitised sound
+    const unsigned int MC_MEMORY_SIZE = 1u << 24;
+    const unsigned int MC_DISPLAY_WIDTH = 256;
+    const unsigned int MC_DISPLAY_HEIGHT = 192;
+    const unsigned int MC_PALETTE_SIZE = 256;
+
+    // Value of hires in the MEGA-CHIP mode (0011), 0 and 1 are the SUPER-CHIP modes
+    const uint8_t MC_MEGA_MODE = 2;
+
+    // Blending of the sprite colours over the screen (080N)
+    enum class MegaChipBlend : uint8_t {
+        Normal = 0,     // alpha of the palette colour
+        Alpha25 = 1,
+        Alpha50 = 2,
+        Alpha75 = 3,
+        Add = 4,        // saturated
+        Multiply = 5,
+    };
+
+    // Own state type, compiled only for the MEGA-CHIP ROMs: CHIP8EmulatorState is unchanged
+    // 16 MiB: allocate it on the heap (std::make_unique) and initialize it in place.
+    //
+    // The display is kept twice: the palette indices drawn, used by the collisions and the SUPER-CHIP
+    // modes (1 bit per pixel in the top-left 64 x 32 or 128 x 64 pixels), and the blended ARGB colours
+    // of the MEGA-CHIP mode.
+    struct alignas(C8_CACHE_LINE_SIZE) MegaChipState {
+        static constexpr Platform platform = Platform::MEGACHIP;
+        static constexpr unsigned int memory_size = MC_MEMORY_SIZE;
+
+        ////////////////////////////////
+        // Hot: registers, see CHIP8EmulatorState
+        // I is 24 bits here, so the stack ends 4 bytes after the first cache line
+        ////////////////////////////////
+        uint8_t V[C8_REGISTER_SIZE]{};
+        uint16_t pc{};
+        uint16_t opcode{};
+        uint16_t keypad{};
+        uint8_t sp{};
+        uint8_t delay_timer{};
+        uint8_t sound_timer{};
+
+        ////// Resolution ///////
+        // * 0: 64 x 32, 1: 128 x 64, MC_MEGA_MODE: 256 x 192
+        uint8_t hires{};
+
+        ////// Sprites ///////
+        // * MegaChipBlend (080N)
+        uint8_t blend_mode{};
+        // * palette index detected by the collisions (09NN)
+        uint8_t collision_colour{};
+
+        uint32_t I{};
+        uint32_t rng{C8_DEFAULT_SEED};
+        uint16_t stack[16]{};
+
+        ////////////////////////////////
+        // Cold registers and bookkeeping
+        ////////////////////////////////
+
+        // Incremental memory hash, see CHIP8EmulatorState
+        alignas(C8_CACHE_LINE_SIZE) uint64_t memory_hash{};
+        // Incremental display hash: XOR of line_hashes, updated with the lines written
+        uint64_t display_hash{};
+
+        // * set when the display or the palette has been written
+        bool dirty_display{};
+
+        // Interpreter behaviours of the ROM, SUPER-CHIP's by default
+        QuirkProfile quirks{QuirkProfile::SuperChip};
+
+        // * Size of the sprites of the MEGA-CHIP mode (03NN, 04NN), 0 is 256
+        uint8_t sprite_width{};
+        uint8_t sprite_height{};
+
+        // * Alpha of the whole screen (05NN), applied when presenting
+        uint8_t screen_alpha{0xFF};
+
+        ////// Digitised sound ///////
+        // * Address of the sound header (060N), the playback is left to the host
+        uint32_t sound_address{};
+        bool sound_playing{};
+        bool sound_loop{};
+
+        ////// User flags ///////
+        uint8_t rpl[C8_RPL_FLAGS_SIZE]{};
+
+        ////////////////////////////////
+        // Cold: bulk arrays
+        ////////////////////////////////
+
+        // * ARGB (0xAARRGGBB), entry 0 is transparent
+        alignas(C8_CACHE_LINE_SIZE) uint32_t palette[MC_PALETTE_SIZE]{};
+
+        // * Hash of the indices and colours of each display line
+        alignas(C8_CACHE_LINE_SIZE) uint64_t line_hashes[MC_DISPLAY_HEIGHT]{};
+
+        ////// Graphics Display ///////
+        // * MC_DISPLAY_WIDTH per line, whatever the mode
+        alignas(C8_CACHE_LINE_SIZE) uint8_t indices[MC_DISPLAY_HEIGHT * MC_DISPLAY_WIDTH]{};
+        alignas(C8_CACHE_LINE_SIZE) uint32_t colours[MC_DISPLAY_HEIGHT * MC_DISPLAY_WIDTH]{};
+
+        /////// Memory ///////
+        // * Same map as CHIP-8 (font at 0x50, program at 0x200) up to 0xFFFFFF
+        alignas(C8_CACHE_LINE_SIZE) uint8_t memory[MC_MEMORY_SIZE]{};
+    };
+
+    static_assert(offsetof(MegaChipState, hires) < offsetof(MegaChipState, I), "Unexpected hot field layout");
+    static_assert(offsetof(MegaChipState, stack) + sizeof(MegaChipState::stack) == C8_CACHE_LINE_SIZE + 4,
+                  "The registers must fit in the first cache line and the stack right after");
+    static_assert(offsetof(MegaChipState, rpl) + sizeof(MegaChipState::rpl) <= offsetof(MegaChipState, palette),
+                  "The cold registers must fit in a single cache line");
+
+    inline bool is_key_pressed(const MegaChipState& state, uint8_t key) {
+        return is_key_pressed(state.keypad, key);
+    }
+
+    inline void set_key(MegaChipState& state, uint8_t key, bool pressed) {
+        uint16_t mask = 1u << (key & 0x0Fu);
+        state.keypad = pressed ? (state.keypad | mask) : (state.keypad & ~mask);
+    }
+
+    inline unsigned int display_width(const MegaChipState& state) {
+        return state.hires == MC_MEGA_MODE ? MC_DISPLAY_WIDTH : state.hires ? C8_HIRES_WIDTH : C8_DISPLAY_WIDTH;
+    }
+
+    inline unsigned int display_height(const MegaChipState& state) {
+        return state.hires == MC_MEGA_MODE ? MC_DISPLAY_HEIGHT : state.hires ? C8_HIRES_HEIGHT : C8_DISPLAY_HEIGHT;
+    }
+
+    // ARGB colour of a pixel, white on black in the SUPER-CHIP modes
+    inline uint32_t get_pixel(const MegaChipState& state, unsigned int x, unsigned int y) {
+        if (state.hires == MC_MEGA_MODE) {
+            return state.colours[y * MC_DISPLAY_WIDTH + x];
+        }
+        return state.indices[y * MC_DISPLAY_WIDTH + x] ? 0xFFFFFFFFu : 0xFF000000u;
+    }
+
+    // The state is 16 MiB: it is initialized in place, never build one on the stack
+    void create_megachip(MegaChipState& state);
+
+    void seed_random(MegaChipState& state, uint64_t seed);
+
+    void reset_state(MegaChipState& state);
+
+    // ROMs larger than the memory after 0x200 are truncated
+    void load_rom_from_buffer(MegaChipState& state, uint8_t* rom, int size);
+
+    // Same contracts as the CHIP8EmulatorState versions
+    size_t patch_rom(MegaChipState& state, const uint8_t* old_rom, size_t old_size, const uint8_t* rom, size_t size);
+
+    void emulate_cycle(MegaChipState& state);
+
+    void update_timers(MegaChipState& state);
+
+    unsigned int emulate_frame(MegaChipState& state, unsigned int nb_cycles);
+
+    // O(palette): the palette is hashed on each call, the memory and the display come from the
+    // incremental hashes
+    uint64_t hash_state(const MegaChipState& state);
+
+    void rehash_state(MegaChipState& state);
+
+    void destroy_megachip(MegaChipState& state);
+}
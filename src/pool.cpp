@@ -0,0 +1,169 @@
+#include "pool.h"
+
+#include <algorithm>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sched.h>
+#endif
+
+#ifdef CHIP8_HAVE_NUMA
+#include <numa.h>
+#endif
+
+namespace chip8 {
+
+    static_assert(POOL_SLAB_SIZE % C8_CACHE_LINE_SIZE == 0, "Slabs must keep the instances cache line aligned");
+    static_assert(sizeof(CHIP8EmulatorState) % C8_CACHE_LINE_SIZE == 0, "Instances must stay cache line aligned in a slab");
+
+    static bool allocate_slab(PoolSlab& slab, int numa_node) {
+#ifdef __linux__
+        // Explicit huge page first, only available if the administrator reserved some
+        void* memory = mmap(nullptr, POOL_SLAB_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        slab.huge_pages = memory != MAP_FAILED;
+
+        if (memory == MAP_FAILED) {
+            // Over-allocate to align the slab on a huge page boundary, so transparent huge pages can back it
+            size_t length = 2 * POOL_SLAB_SIZE;
+            uint8_t* raw = static_cast<uint8_t*>(mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (raw == MAP_FAILED) {
+                return false;
+            }
+            uintptr_t address = reinterpret_cast<uintptr_t>(raw);
+            uintptr_t aligned = (address + POOL_SLAB_SIZE - 1) & ~(uintptr_t)(POOL_SLAB_SIZE - 1);
+            size_t head = aligned - address;
+            if (head) {
+                munmap(raw, head);
+            }
+            munmap(reinterpret_cast<uint8_t*>(aligned) + POOL_SLAB_SIZE, POOL_SLAB_SIZE - head);
+
+            memory = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+            slab.huge_pages = madvise(memory, POOL_SLAB_SIZE, MADV_HUGEPAGE) == 0;
+#endif
+        }
+#else
+        void* memory = ::operator new(POOL_SLAB_SIZE, std::align_val_t(C8_CACHE_LINE_SIZE), std::nothrow);
+        if (!memory) {
+            return false;
+        }
+        slab.huge_pages = false;
+#endif
+
+#ifdef CHIP8_HAVE_NUMA
+        if (numa_node >= 0 && numa_available() >= 0) {
+            numa_tonode_memory(memory, POOL_SLAB_SIZE, numa_node);
+        }
+#else
+        (void)numa_node;
+#endif
+
+        slab.memory = static_cast<uint8_t*>(memory);
+        slab.used = 0;
+        return true;
+    }
+
+    static void free_slab(PoolSlab& slab) {
+#ifdef __linux__
+        munmap(slab.memory, POOL_SLAB_SIZE);
+#else
+        ::operator delete(slab.memory, std::align_val_t(C8_CACHE_LINE_SIZE));
+#endif
+        slab.memory = nullptr;
+    }
+
+    bool create_pool(InstancePool& pool, size_t capacity, int numa_node) {
+        pool.numa_node = numa_node;
+        size_t nb_slabs = (capacity + POOL_INSTANCES_PER_SLAB - 1) / POOL_INSTANCES_PER_SLAB;
+        for (size_t i = 0; i < nb_slabs; i++) {
+            PoolSlab slab;
+            if (!allocate_slab(slab, numa_node)) {
+                // Nothing is left allocated on failure
+                destroy_pool(pool);
+                return false;
+            }
+            pool.slabs.push_back(slab);
+        }
+        return true;
+    }
+
+    // Next never used slot, allocating a new slab if all of them are full
+    static void* bump(InstancePool& pool) {
+        while (pool.current_slab < pool.slabs.size()
+               && pool.slabs[pool.current_slab].used == POOL_INSTANCES_PER_SLAB) {
+            pool.current_slab += 1;
+        }
+
+        if (pool.current_slab == pool.slabs.size()) {
+            PoolSlab slab;
+            if (!allocate_slab(slab, pool.numa_node)) {
+                return nullptr;
+            }
+            pool.slabs.push_back(slab);
+        }
+
+        PoolSlab& slab = pool.slabs[pool.current_slab];
+        void* slot = slab.memory + slab.used * sizeof(CHIP8EmulatorState);
+        slab.used += 1;
+        return slot;
+    }
+
+    CHIP8EmulatorState* acquire_instance(InstancePool& pool, const CHIP8EmulatorState* prototype) {
+        void* slot = pool.free_list;
+        if (slot) {
+            pool.free_list = *static_cast<void**>(slot);
+        } else {
+            slot = bump(pool);
+            if (!slot) {
+                return nullptr;
+            }
+        }
+
+        pool.nb_acquired += 1;
+        return prototype ? new (slot) CHIP8EmulatorState(*prototype)
+                         : new (slot) CHIP8EmulatorState(create_chip8emulator());
+    }
+
+    void release_instance(InstancePool& pool, CHIP8EmulatorState* state) {
+        destroy_chip8emulator(*state);
+        state->~CHIP8EmulatorState();
+
+        *reinterpret_cast<void**>(state) = pool.free_list;
+        pool.free_list = state;
+        pool.nb_acquired -= 1;
+    }
+
+    void reset_pool(InstancePool& pool) {
+        for (PoolSlab& slab : pool.slabs) {
+            slab.used = 0;
+        }
+        pool.free_list = nullptr;
+        pool.current_slab = 0;
+        pool.nb_acquired = 0;
+    }
+
+    void destroy_pool(InstancePool& pool) {
+        for (PoolSlab& slab : pool.slabs) {
+            free_slab(slab);
+        }
+        pool.slabs.clear();
+        pool.free_list = nullptr;
+        pool.current_slab = 0;
+        pool.nb_acquired = 0;
+    }
+
+    int current_numa_node() {
+#if defined(CHIP8_HAVE_NUMA) && defined(__linux__)
+        if (numa_available() >= 0) {
+            int cpu = sched_getcpu();
+            if (cpu >= 0) {
+                return std::max(0, numa_node_of_cpu(cpu));
+            }
+        }
+#endif
+        return 0;
+    }
+}
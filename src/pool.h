@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    // Slabs are sized and aligned on x86-64 huge pages
+    const size_t POOL_SLAB_SIZE = 2 * 1024 * 1024;
+    const size_t POOL_INSTANCES_PER_SLAB = POOL_SLAB_SIZE / sizeof(CHIP8EmulatorState);
+
+    struct PoolSlab {
+        uint8_t* memory{};
+        // Slots [0, used) have been handed out at least once since the last reset
+        size_t used{};
+        bool huge_pages{};
+    };
+
+    // Pool allocator for large populations of instances
+    //
+    // Instances live in 2 MiB slabs backed by huge pages when the system allows it (explicit hugetlb
+    // pages, then transparent huge pages), every instance being cache line aligned. Acquire and
+    // release are O(1) (bump pointer + intrusive free list), reset_pool releases everything at once.
+    //
+    // A pool is not thread safe: use one pool per worker thread. Slabs are bound to numa_node when
+    // libnuma is available, otherwise they are first touched (hence placed) by the acquiring thread.
+    struct InstancePool {
+        std::vector<PoolSlab> slabs;
+
+        // Released instances, linked through their first bytes
+        void* free_list{};
+
+        // Slab currently bumped
+        size_t current_slab{};
+
+        size_t nb_acquired{};
+
+        // -1: no binding
+        int numa_node{-1};
+    };
+
+    // Preallocate enough slabs for capacity instances, the pool is left empty if one cannot be allocated
+    bool create_pool(InstancePool& pool, size_t capacity, int numa_node = -1);
+
+    // Return a state initialized like create_chip8emulator, or a copy of prototype if given
+    // Return nullptr if the system is out of memory
+    CHIP8EmulatorState* acquire_instance(InstancePool& pool, const CHIP8EmulatorState* prototype = nullptr);
+
+    void release_instance(InstancePool& pool, CHIP8EmulatorState* state);
+
+    // Release every instance, the slabs are kept for reuse
+    void reset_pool(InstancePool& pool);
+
+    void destroy_pool(InstancePool& pool);
+
+    // NUMA node of the CPU the calling thread runs on (0 if unknown)
+    int current_numa_node();
+}
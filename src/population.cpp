@@ -0,0 +1,96 @@
+#include "population.h"
+
+#include <algorithm>
+
+namespace chip8 {
+
+    CHIP8Snapshot create_rom_image(const uint8_t* rom, int size) {
+        CHIP8EmulatorState state = create_chip8emulator();
+        load_rom_from_buffer(state, const_cast<uint8_t*>(rom), size);
+        CHIP8Snapshot image = capture_snapshot(state, nullptr);
+        destroy_chip8emulator(state);
+        return image;
+    }
+
+    static_assert(C8_START_ADDRESS % C8_PAGE_SIZE == 0, "ROM pages must start at a file offset multiple of C8_PAGE_SIZE");
+
+    CHIP8Snapshot create_rom_image(const RomFile& file) {
+        // map_rom_file does not check the size: past the CHIP-8 memory there are no pages
+        size_t size = std::min(file.size, rom_capacity(Platform::CHIP8));
+
+        // Parent holding only the ROM pages entirely covered by the file, as aliases of the mapping
+        CHIP8Snapshot mapped;
+        size_t nb_full_pages = size / C8_PAGE_SIZE;
+        for (size_t page = 0; page < nb_full_pages; page++) {
+            const CHIP8Page* bytes = reinterpret_cast<const CHIP8Page*>(file.data + page * C8_PAGE_SIZE);
+            mapped.pages[C8_START_ADDRESS / C8_PAGE_SIZE + page] = std::shared_ptr<const CHIP8Page>(file.mapping, bytes);
+        }
+
+        // The state only provides the hot line, the font and the hashes: captured against mapped
+        // with no page marked as written, the ROM pages are shared instead of copied
+        CHIP8EmulatorState state = create_chip8emulator();
+        load_rom_from_buffer(state, const_cast<uint8_t*>(file.data), static_cast<int>(size));
+        state.dirty_pages = 0;
+        CHIP8Snapshot image = capture_snapshot(state, &mapped);
+        destroy_chip8emulator(state);
+        return image;
+    }
+
+    CHIP8Population create_population(const uint8_t* rom, int size, size_t nb_instances) {
+        CHIP8Population population;
+        population.image = create_rom_image(rom, size);
+        population.instances.assign(nb_instances, population.image);
+        population.work = create_chip8emulator();
+        population.work_matches = nullptr;
+        return population;
+    }
+
+    CHIP8Population create_population(const RomFile& file, size_t nb_instances) {
+        CHIP8Population population;
+        population.image = create_rom_image(file);
+        population.instances.assign(nb_instances, population.image);
+        population.work = create_chip8emulator();
+        population.work_matches = nullptr;
+        return population;
+    }
+
+    void set_population_keypad(CHIP8Population& population, size_t instance, uint16_t keypad) {
+        memcpy(&population.instances[instance].hot[offsetof(CHIP8EmulatorState, keypad)], &keypad, sizeof(uint16_t));
+    }
+
+    void run_population(CHIP8Population& population, unsigned int nb_frames, unsigned int nb_cycles) {
+        for (CHIP8Snapshot& instance : population.instances) {
+            // Pages shared with the previous instance (the ROM image ones usually) are not copied again
+            restore_snapshot(instance, population.work, population.work_matches);
+
+            for (unsigned int f = 0; f < nb_frames; f++) {
+                emulate_frame(population.work, nb_cycles);
+            }
+
+            // Pages written by this instance become private, the others stay shared
+            instance = capture_snapshot(population.work, &instance);
+            population.work_matches = &instance;
+        }
+    }
+
+    CHIP8EmulatorState get_population_state(const CHIP8Population& population, size_t instance) {
+        CHIP8EmulatorState state;
+        restore_snapshot(population.instances[instance], state);
+        return state;
+    }
+
+    size_t population_memory_bytes(const CHIP8Population& population) {
+        size_t bytes = 0;
+        for (const CHIP8Snapshot& instance : population.instances) {
+            bytes += sizeof(CHIP8Snapshot) - sizeof(instance.hot);
+            bytes += snapshot_private_bytes(instance, population.image);
+        }
+        return bytes;
+    }
+
+    void destroy_population(CHIP8Population& population) {
+        population.instances.clear();
+        population.work_matches = nullptr;
+        destroy_chip8emulator(population.work);
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include "snapshot.h"
+#include "rom_file.h"
+
+namespace chip8 {
+
+    // Read-only memory image shared by every instance running the same ROM (font at 0x50, ROM at 0x200)
+    // It is the root snapshot of all of them: an instance only owns the pages it writes (FX33/FX55)
+    // and a display page once it draws.
+    CHIP8Snapshot create_rom_image(const uint8_t* rom, int size);
+
+    // Same image built from a mapped ROM file: the pages entirely covered by the ROM (0x200 is
+    // page aligned) point into the mapping instead of holding a copy, only the font page and the
+    // last, partial, ROM page are copied. ROMs past the CHIP-8 memory are truncated.
+    //
+    // The mapping is MAP_PRIVATE, not a copy: the file must not be rewritten or truncated while the
+    // image or any snapshot derived from it is alive (a rewrite shows through, a truncation faults).
+    // Use create_rom_image(rom, size) for files that may change, e.g. under hot reload.
+    CHIP8Snapshot create_rom_image(const RomFile& file);
+
+    // Large set of instances stored as snapshots of the same ROM image
+    //
+    // An instance costs ~400 bytes (hot line + page references) plus its private pages, instead of a
+    // full CHIP8EmulatorState. Instances are run one after the other in a single dense work state.
+    struct CHIP8Population {
+        CHIP8Snapshot image;
+        std::vector<CHIP8Snapshot> instances;
+
+        // Dense state the instances are run in, and the snapshot it currently matches
+        CHIP8EmulatorState work;
+        const CHIP8Snapshot* work_matches{};
+    };
+
+    CHIP8Population create_population(const uint8_t* rom, int size, size_t nb_instances);
+    CHIP8Population create_population(const RomFile& file, size_t nb_instances);
+
+    // Set the keypad of an instance
+    void set_population_keypad(CHIP8Population& population, size_t instance, uint16_t keypad);
+
+    // Advance every instance by nb_frames frames of nb_cycles
+    void run_population(CHIP8Population& population, unsigned int nb_frames, unsigned int nb_cycles);
+
+    // Full state of one instance
+    CHIP8EmulatorState get_population_state(const CHIP8Population& population, size_t instance);
+
+    // Bytes used by the instances: snapshots plus the pages they do not share with the image
+    size_t population_memory_bytes(const CHIP8Population& population);
+
+    void destroy_population(CHIP8Population& population);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+namespace chip8 {
+
+    // Behaviours on which the CHIP-8 interpreters disagree, selected per ROM
+    //
+    // The interpreter is instantiated once per profile (see interpreter.h): in the handlers the
+    // quirks are compile-time constants, so supporting them adds no branch to the hot handlers.
+    enum class QuirkProfile : uint8_t {
+        // Behaviour of this emulator before the profiles existed: SUPER-CHIP shifts and loads,
+        // CHIP-8 jump, wrapping sprites
+        Default = 0,
+        // COSMAC VIP CHIP-8
+        Chip8 = 1,
+        // SUPER-CHIP 1.1 (HP48)
+        SuperChip = 2,
+        // XO-CHIP (Octo)
+        XOChip = 3,
+    };
+
+    const unsigned int C8_QUIRK_PROFILE_COUNT = 4;
+
+    struct QuirkSet {
+        // 8XY6/8XYE shift VY into VX instead of shifting VX
+        bool shift_uses_vy;
+        // FX55/FX65 leave I at I + X + 1
+        bool load_store_increments_i;
+        // BXNN jumps to XNN + VX instead of NNN + V0
+        bool jump_uses_vx;
+        // 8XY1/8XY2/8XY3 set VF to 0
+        bool logic_resets_vf;
+        // DXYN clips the sprites at the edges of the display instead of wrapping them
+        bool clip_sprites;
+    };
+
+    // Usable at compile time (interpreter.h) as well as at run time (batch kernels)
+    constexpr QuirkSet quirk_set(QuirkProfile profile) {
+        switch (profile) {
+            case QuirkProfile::Chip8:     return {true,  true,  false, true,  true};
+            case QuirkProfile::SuperChip: return {false, false, true,  false, true};
+            case QuirkProfile::XOChip:    return {true,  true,  false, false, false};
+            default:                      return {false, false, false, false, false};
+        }
+    }
+
+    constexpr const char* quirk_profile_name(QuirkProfile profile) {
+        switch (profile) {
+            case QuirkProfile::Chip8:     return "CHIP-8";
+            case QuirkProfile::SuperChip: return "SUPER-CHIP";
+            case QuirkProfile::XOChip:    return "XO-CHIP";
+            default:                      return "Default";
+        }
+    }
+}
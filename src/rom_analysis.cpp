@@ -0,0 +1,229 @@
+#include "rom_analysis.h"
+
+#include <vector>
+
+namespace chip8 {
+
+    // Straight-line instructions inspected after FX55/FX65 for a use of I
+    const unsigned int ANALYSIS_I_REUSE_WINDOW = 8;
+
+    enum class RegisterIUse {
+        None,
+        Read,
+        Set,
+    };
+
+    static inline bool in_image(size_t size, uint32_t address) {
+        return address >= C8_START_ADDRESS && address - C8_START_ADDRESS + 1 < size;
+    }
+
+    static inline uint16_t fetch(const uint8_t* rom, uint32_t address) {
+        return (rom[address - C8_START_ADDRESS] << 8) | rom[address - C8_START_ADDRESS + 1];
+    }
+
+    static RegisterIUse register_i_use(uint16_t opcode) {
+        switch (opcode >> 12) {
+            case 0x5: return (opcode & 0x000Fu) == 0x2u || (opcode & 0x000Fu) == 0x3u ? RegisterIUse::Read : RegisterIUse::None;
+            case 0xA: return RegisterIUse::Set;
+            case 0xD: return RegisterIUse::Read;
+            case 0xF:
+                switch (opcode & 0x00FFu) {
+                    case 0x00: case 0x29: case 0x30: return RegisterIUse::Set;
+                    case 0x02: case 0x1E: case 0x33: case 0x55: case 0x65: return RegisterIUse::Read;
+                    default: return RegisterIUse::None;
+                }
+            default: return RegisterIUse::None;
+        }
+    }
+
+    static inline bool is_control_flow(uint16_t opcode) {
+        uint8_t type = opcode >> 12;
+        return opcode == 0x00EEu || opcode == 0x00FDu || type == 0x1 || type == 0x2 || type == 0xB;
+    }
+
+    static bool writes_register(uint16_t opcode, uint8_t r) {
+        const uint8_t X = (opcode & 0x0F00u) >> 8;
+        switch (opcode >> 12) {
+            case 0x6: case 0x7: case 0x8: case 0xC:
+                return X == r;
+            case 0xF:
+                switch (opcode & 0x00FFu) {
+                    case 0x07: case 0x0A: return X == r;
+                    case 0x65: case 0x85: return r <= X;
+                    default: return false;
+                }
+            default:
+                return false;
+        }
+    }
+
+    // First instruction using I in the straight-line code after the FX55/FX65 at address, 0 if I is
+    // set again (or the code branches) before
+    static uint16_t next_register_i_read(const uint8_t* rom, size_t size, uint32_t address) {
+        for (unsigned int i = 1; i <= ANALYSIS_I_REUSE_WINDOW; i++) {
+            uint32_t next = address + 2 * i;
+            if (!in_image(size, next)) {
+                return 0;
+            }
+
+            uint16_t opcode = fetch(rom, next);
+            RegisterIUse use = register_i_use(opcode);
+            if (use != RegisterIUse::None) {
+                return use == RegisterIUse::Read ? opcode : 0;
+            }
+            if (is_control_flow(opcode)) {
+                return 0;
+            }
+        }
+        return 0;
+    }
+
+    // Count the instructions reachable from the start address
+    // 01NN NNNN is only 4 bytes long in MEGA-CHIP mode, which is set by analyze_rom once a first
+    // walk has found a 0011: the order in which the code is walked must not change its length.
+    static RomAnalysis walk_rom(const uint8_t* rom, size_t size, bool megachip) {
+        RomAnalysis analysis;
+
+        // One flag per byte of the image: instructions are not necessarily aligned on 2 bytes
+        std::vector<uint8_t> visited(size, 0);
+        std::vector<uint32_t> pending;
+
+        auto visit = [&](uint32_t address) {
+            if (in_image(size, address) && !visited[address - C8_START_ADDRESS]) {
+                visited[address - C8_START_ADDRESS] = 1;
+                pending.push_back(address);
+            }
+        };
+        // Skips jump over the 4 bytes of F000 NNNN on XO-CHIP (F000 is not an instruction elsewhere)
+        auto visit_skip = [&](uint32_t next) {
+            visit(next);
+            visit(in_image(size, next) && fetch(rom, next) == 0xF000u ? next + 4 : next + 2);
+        };
+
+        visit(C8_START_ADDRESS);
+        while (!pending.empty()) {
+            const uint32_t address = pending.back();
+            pending.pop_back();
+
+            const uint16_t opcode = fetch(rom, address);
+            const uint8_t X = (opcode & 0x0F00u) >> 8;
+            const uint8_t Y = (opcode & 0x00F0u) >> 4;
+            const uint8_t N = (opcode & 0x000Fu);
+            const uint8_t NN = (opcode & 0x00FFu);
+            uint32_t next = address + 2;
+
+            analysis.reachable_instructions += 1;
+
+            switch (opcode >> 12) {
+                case 0x0:
+                    if (opcode == 0x00EEu) {
+                        continue;
+                    }
+                    if (opcode == 0x00FDu) {
+                        analysis.superchip_instructions += 1;
+                        continue;
+                    }
+                    if ((opcode & 0xFFF0u) == 0x00C0u || (opcode >= 0x00FBu && opcode <= 0x00FFu)) {
+                        analysis.superchip_instructions += 1;
+                    } else if ((opcode & 0xFFF0u) == 0x00D0u) {
+                        analysis.xochip_instructions += 1;
+                    } else if (opcode == 0x0011u) {
+                        analysis.megachip_instructions += 1;
+                    } else if ((opcode & 0xFF00u) == 0x0100u && megachip) {
+                        // 01NN NNNN
+                        next += 2;
+                    }
+                    break;
+                case 0x1:
+                    visit(opcode & 0x0FFFu);
+                    continue;
+                case 0x2:
+                    visit(opcode & 0x0FFFu);
+                    break;
+                case 0x3: case 0x4: case 0x9:
+                    visit_skip(next);
+                    continue;
+                case 0x5:
+                    if (N == 0x2 || N == 0x3) {
+                        analysis.xochip_instructions += 1;
+                        break;
+                    }
+                    visit_skip(next);
+                    continue;
+                case 0x8:
+                    if ((N == 0x6 || N == 0xE) && X != Y && in_image(size, address - 2)) {
+                        uint16_t previous = fetch(rom, address - 2);
+                        if (writes_register(previous, X)) {
+                            analysis.shifts_reading_vx += 1;
+                        } else if (writes_register(previous, Y)) {
+                            analysis.shifts_reading_vy += 1;
+                        }
+                    }
+                    break;
+                case 0xB:
+                    analysis.jumps_with_vx += X != 0;
+                    analysis.computed_jumps += 1;
+                    continue;
+                case 0xD:
+                    analysis.superchip_instructions += N == 0;
+                    break;
+                case 0xE:
+                    if (NN == 0x9E || NN == 0xA1) {
+                        visit_skip(next);
+                        continue;
+                    }
+                    break;
+                case 0xF:
+                    if (opcode == 0xF000u) {
+                        analysis.xochip_instructions += 1;
+                        next += 2;
+                    } else if (NN == 0x01 || opcode == 0xF002u || NN == 0x3A) {
+                        analysis.xochip_instructions += 1;
+                    } else if (NN == 0x30) {
+                        analysis.superchip_instructions += 1;
+                    } else if (NN == 0x75 || NN == 0x85) {
+                        // 8 user flags on SUPER-CHIP, 16 on XO-CHIP
+                        if (X > 7) {
+                            analysis.xochip_instructions += 1;
+                        } else {
+                            analysis.superchip_instructions += 1;
+                        }
+                    } else if (NN == 0x55 || NN == 0x65) {
+                        uint16_t read = next_register_i_read(rom, size, address);
+                        if ((read & 0xF0FFu) == (opcode & 0xF0FFu)) {
+                            analysis.load_store_advancing_i += 1;
+                        } else if ((read & 0xF0FFu) == 0xF055u || (read & 0xF0FFu) == 0xF065u) {
+                            analysis.load_store_keeping_i += 1;
+                        }
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            visit(next);
+        }
+        return analysis;
+    }
+
+    RomAnalysis analyze_rom(const uint8_t* rom, size_t size) {
+        RomAnalysis analysis = walk_rom(rom, size, false);
+        if (analysis.megachip_instructions) {
+            analysis = walk_rom(rom, size, true);
+        }
+
+        if (analysis.megachip_instructions) {
+            analysis.platform = Platform::MEGACHIP;
+            analysis.quirks = QuirkProfile::SuperChip;
+        } else if (analysis.xochip_instructions || size > C8_MEMORY_SIZE - C8_START_ADDRESS) {
+            analysis.platform = Platform::XOCHIP;
+            analysis.quirks = QuirkProfile::XOChip;
+        } else if (analysis.superchip_instructions) {
+            analysis.quirks = QuirkProfile::SuperChip;
+        } else if (analysis.shifts_reading_vy + analysis.load_store_advancing_i
+                   > analysis.shifts_reading_vx + analysis.load_store_keeping_i) {
+            analysis.quirks = QuirkProfile::Chip8;
+        }
+        return analysis;
+    }
+}
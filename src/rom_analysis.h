@@ -0,0 +1,44 @@
+#pragma once
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    // Result of the static analysis of a ROM image (analyze_rom)
+    struct RomAnalysis {
+        // Instructions reached from 0x200 by following the control flow
+        unsigned int reachable_instructions{};
+        // * BNNN: the target is unknown, the walk of that path ends there
+        unsigned int computed_jumps{};
+
+        // Reachable instructions only defined by an extension
+        // * SUPER-CHIP: 00CN, 00FB-00FF, DXY0, FX30, FX75, FX85
+        unsigned int superchip_instructions{};
+        // * XO-CHIP: 00DN, 5XY2, 5XY3, F000 NNNN, FN01, F002, FX3A, FX75/FX85 with X > 7
+        unsigned int xochip_instructions{};
+        // * MEGA-CHIP: 0011 (entering the MEGA-CHIP mode)
+        unsigned int megachip_instructions{};
+
+        // Quirk-sensitive patterns, X != Y shifts and FX55/FX65 followed by a use of I before I is set
+        // * 8XY6/8XYE right after a write to VY: the shift reads VY (COSMAC VIP)
+        unsigned int shifts_reading_vy{};
+        // * 8XY6/8XYE right after a write to VX: the shift reads VX (CHIP-48, SUPER-CHIP)
+        unsigned int shifts_reading_vx{};
+        // * FX55 followed by FX55 (or FX65 by FX65): consecutive records, I + X + 1 expected (COSMAC VIP)
+        unsigned int load_store_advancing_i{};
+        // * FX65 followed by FX55 (or the reverse): read-modify-write of the same bytes, I expected
+        //   unchanged (CHIP-48, SUPER-CHIP)
+        unsigned int load_store_keeping_i{};
+        // * BXNN with X != 0
+        unsigned int jumps_with_vx{};
+
+        // Most likely platform and quirk profile
+        Platform platform{Platform::CHIP8};
+        QuirkProfile quirks{QuirkProfile::Default};
+    };
+
+    // Walk the ROM image (as loaded at 0x200) along its control flow without executing it and infer
+    // its platform and quirks from the instructions it can reach. O(size), no emulation: cheap enough
+    // to run on every load and on whole ROM libraries.
+    RomAnalysis analyze_rom(const uint8_t* rom, size_t size);
+}
@@ -0,0 +1,349 @@
+#include "rom_archive.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#ifdef CHIP8_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace chip8 {
+
+    // zip signatures and fixed header sizes
+    const uint32_t ZIP_LOCAL_HEADER = 0x04034b50;
+    const uint32_t ZIP_CENTRAL_HEADER = 0x02014b50;
+    const uint32_t ZIP_END_OF_DIRECTORY = 0x06054b50;
+    const size_t ZIP_LOCAL_HEADER_SIZE = 30;
+    const size_t ZIP_CENTRAL_HEADER_SIZE = 46;
+    const size_t ZIP_END_OF_DIRECTORY_SIZE = 22;
+    // The end of central directory record is followed by a comment of at most 64 KiB
+    const size_t ZIP_MAX_COMMENT_SIZE = 0xFFFF;
+
+    const size_t TAR_BLOCK_SIZE = 512;
+
+    // zip fields are little-endian whatever the host
+    static inline uint16_t read_u16(const uint8_t* bytes) {
+        return bytes[0] | (bytes[1] << 8);
+    }
+
+    static inline uint32_t read_u32(const uint8_t* bytes) {
+        return read_u16(bytes) | (static_cast<uint32_t>(read_u16(bytes + 2)) << 16);
+    }
+
+    static bool is_rom_name(const std::string& name) {
+        size_t dot = name.rfind('.');
+        if (dot == std::string::npos || name.back() == '/') {
+            return false;
+        }
+        std::string extension = name.substr(dot);
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".ch8" || extension == ".sc8" || extension == ".xo8";
+    }
+
+    static bool index_zip(RomArchive& archive) {
+        const uint8_t* data = archive.file.data;
+        size_t size = archive.file.size;
+        if (size < ZIP_END_OF_DIRECTORY_SIZE) {
+            return false;
+        }
+
+        // Last end of central directory signature, searched backwards over the comment
+        size_t end = size - ZIP_END_OF_DIRECTORY_SIZE;
+        size_t lowest = end > ZIP_MAX_COMMENT_SIZE ? end - ZIP_MAX_COMMENT_SIZE : 0;
+        while (read_u32(data + end) != ZIP_END_OF_DIRECTORY) {
+            if (end == lowest) {
+                return false;
+            }
+            end -= 1;
+        }
+
+        // ZIP64 archives (over 65535 entries or 4 GiB) are not supported
+        uint16_t nb_entries = read_u16(data + end + 10);
+        uint32_t directory_size = read_u32(data + end + 12);
+        uint32_t directory_offset = read_u32(data + end + 16);
+        if (static_cast<uint64_t>(directory_offset) + directory_size > end) {
+            return false;
+        }
+
+        size_t offset = directory_offset;
+        for (unsigned int i = 0; i < nb_entries; i++) {
+            if (offset + ZIP_CENTRAL_HEADER_SIZE > end || read_u32(data + offset) != ZIP_CENTRAL_HEADER) {
+                return false;
+            }
+            const uint8_t* header = data + offset;
+            uint16_t flags = read_u16(header + 8);
+            uint16_t name_size = read_u16(header + 28);
+            size_t header_size = ZIP_CENTRAL_HEADER_SIZE + name_size + read_u16(header + 30) + read_u16(header + 32);
+            if (offset + header_size > end) {
+                return false;
+            }
+
+            ArchiveEntry entry;
+            entry.name.assign(reinterpret_cast<const char*>(header + ZIP_CENTRAL_HEADER_SIZE), name_size);
+            entry.method = read_u16(header + 10);
+            entry.crc = read_u32(header + 16);
+            entry.compressed_size = read_u32(header + 20);
+            entry.size = read_u32(header + 24);
+            uint32_t local_offset = read_u32(header + 42);
+            offset += header_size;
+
+            // Encrypted entries are skipped
+            if ((flags & 0b1) || !is_rom_name(entry.name)) {
+                continue;
+            }
+
+            // The data follows the local header, whose extra field may differ from the central one
+            if (static_cast<uint64_t>(local_offset) + ZIP_LOCAL_HEADER_SIZE > size
+                || read_u32(data + local_offset) != ZIP_LOCAL_HEADER) {
+                return false;
+            }
+            const uint8_t* local = data + local_offset;
+            entry.offset = static_cast<uint64_t>(local_offset) + ZIP_LOCAL_HEADER_SIZE + read_u16(local + 26) + read_u16(local + 28);
+            if (entry.offset + entry.compressed_size > size) {
+                return false;
+            }
+            // The sizes come from the archive: a stored entry must hold as many bytes as it claims,
+            // and a ROM larger than the memory of every platform is not worth listing
+            if ((entry.method == ARCHIVE_STORED && entry.size != entry.compressed_size)
+                || entry.size > rom_capacity(Platform::MEGACHIP)) {
+                continue;
+            }
+            archive.entries.push_back(std::move(entry));
+        }
+        return true;
+    }
+
+    // Octal number (NUL or space terminated), or base-256 if the high bit of the first byte is set
+    static uint64_t parse_tar_number(const uint8_t* field, size_t length) {
+        uint64_t value = 0;
+        if (field[0] & 0x80) {
+            value = field[0] & 0x7F;
+            for (size_t i = 1; i < length; i++) {
+                value = (value << 8) | field[i];
+            }
+            return value;
+        }
+        for (size_t i = 0; i < length && field[i] >= '0' && field[i] <= '7'; i++) {
+            value = (value << 3) | (field[i] - '0');
+        }
+        return value;
+    }
+
+    static std::string tar_string(const uint8_t* field, size_t length) {
+        return std::string(reinterpret_cast<const char*>(field), strnlen(reinterpret_cast<const char*>(field), length));
+    }
+
+    // Value of the path key of a pax extended header, empty if it has none
+    // Records are "<length> <key>=<value>\n", length counting the whole record.
+    static std::string pax_path(const uint8_t* records, size_t size) {
+        std::string path;
+        size_t offset = 0;
+        while (offset < size) {
+            size_t length = 0;
+            size_t i = offset;
+            for (; i < size && records[i] >= '0' && records[i] <= '9' && length <= size; i++) {
+                length = length * 10 + (records[i] - '0');
+            }
+            // Malformed record: the rest of the header is ignored
+            if (i == offset || i >= size || records[i] != ' ' || length > size - offset || offset + length <= i + 1) {
+                break;
+            }
+
+            const char* record = reinterpret_cast<const char*>(records + i + 1);
+            size_t record_size = offset + length - (i + 1);
+            if (record[record_size - 1] == '\n') {
+                record_size -= 1;
+            }
+            if (record_size >= 5 && memcmp(record, "path=", 5) == 0) {
+                path.assign(record + 5, record_size - 5);
+            }
+            offset += length;
+        }
+        return path;
+    }
+
+    static bool is_tar(const RomArchive& archive) {
+        return archive.file.size >= TAR_BLOCK_SIZE && memcmp(archive.file.data + 257, "ustar", 5) == 0;
+    }
+
+    static bool index_tar(RomArchive& archive) {
+        const uint8_t* data = archive.file.data;
+        size_t size = archive.file.size;
+
+        // Name of the next entry from a GNU long name ('L' entry) or a pax extended header ('x' entry)
+        std::string long_name;
+
+        size_t offset = 0;
+        while (offset + TAR_BLOCK_SIZE <= size) {
+            const uint8_t* header = data + offset;
+            // The archive ends with zero blocks (an empty name alone is not the end: ustar directories
+            // whose path fits in the prefix field have one)
+            if (std::all_of(header, header + TAR_BLOCK_SIZE, [](uint8_t byte) { return byte == 0; })) {
+                break;
+            }
+
+            uint64_t entry_size = parse_tar_number(header + 124, 12);
+            uint8_t type = header[156];
+            uint64_t data_offset = offset + TAR_BLOCK_SIZE;
+            // Not data_offset + entry_size > size: a base-256 size can be anything up to 2^64 - 1
+            if (entry_size > size - data_offset) {
+                return false;
+            }
+
+            if (type == 'L') {
+                long_name = tar_string(data + data_offset, entry_size);
+            } else if (type == 'x') {
+                long_name = pax_path(data + data_offset, entry_size);
+            } else if (type == 'g') {
+                // Global pax header: defaults for the whole archive, a path key there names no entry
+            } else {
+                std::string name = long_name;
+                if (name.empty()) {
+                    // ustar: prefix "/" name
+                    name = tar_string(header, 100);
+                    std::string prefix = tar_string(header + 345, 155);
+                    if (!prefix.empty()) {
+                        name = prefix + "/" + name;
+                    }
+                }
+                long_name.clear();
+
+                // Regular files only, ROMs larger than the memory of every platform are not listed
+                if ((type == '0' || type == 0) && entry_size <= rom_capacity(Platform::MEGACHIP) && is_rom_name(name)) {
+                    ArchiveEntry entry;
+                    entry.name = std::move(name);
+                    entry.offset = data_offset;
+                    entry.compressed_size = static_cast<uint32_t>(entry_size);
+                    entry.size = static_cast<uint32_t>(entry_size);
+                    entry.crc = 0;
+                    entry.method = ARCHIVE_STORED;
+                    archive.entries.push_back(std::move(entry));
+                }
+            }
+
+            size_t next = data_offset + (entry_size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+            if (next <= offset) {
+                return false;
+            }
+            offset = next;
+        }
+        return true;
+    }
+
+    bool open_rom_archive(RomArchive& archive, const char* filename) {
+        archive = RomArchive{};
+
+        if (!map_rom_file(archive.file, filename)) {
+            return false;
+        }
+        // Zip first: a tar holding a zip would not be mistaken for one, its end is padding
+        bool ok = false;
+        if (index_zip(archive)) {
+            archive.format = ArchiveFormat::Zip;
+            ok = true;
+        } else if (is_tar(archive)) {
+            archive.entries.clear();
+            archive.format = ArchiveFormat::Tar;
+            ok = index_tar(archive);
+        }
+
+        if (!ok) {
+            fmt::println("{} is not a zip or tar archive, or is corrupted", filename);
+            close_rom_archive(archive);
+            return false;
+        }
+
+        std::sort(archive.entries.begin(), archive.entries.end(),
+                  [](const ArchiveEntry& a, const ArchiveEntry& b) { return a.name < b.name; });
+        return true;
+    }
+
+    void close_rom_archive(RomArchive& archive) {
+        close_rom_file(archive.file);
+        archive.entries.clear();
+    }
+
+    int find_archive_entry(const RomArchive& archive, const std::string& name) {
+        auto it = std::lower_bound(archive.entries.begin(), archive.entries.end(), name,
+                                   [](const ArchiveEntry& entry, const std::string& key) { return entry.name < key; });
+        return it != archive.entries.end() && it->name == name ? static_cast<int>(it - archive.entries.begin()) : -1;
+    }
+
+    const uint8_t* archive_entry_data(const RomArchive& archive, size_t index) {
+        const ArchiveEntry& entry = archive.entries[index];
+        return entry.method == ARCHIVE_STORED ? archive.file.data + entry.offset : nullptr;
+    }
+
+    // Write the entry to [output, output + capacity), the bytes past capacity are dropped
+    static bool inflate_entry(const RomArchive& archive, const ArchiveEntry& entry, uint8_t* output, size_t capacity) {
+        const uint8_t* input = archive.file.data + entry.offset;
+        size_t size = std::min<size_t>(entry.size, capacity);
+
+        if (entry.method == ARCHIVE_STORED) {
+            memcpy(output, input, size);
+            return entry.compressed_size == entry.size;
+        }
+
+#ifdef CHIP8_HAVE_ZLIB
+        if (entry.method == ARCHIVE_DEFLATED) {
+            // Raw deflate stream, no zlib header in a zip
+            z_stream stream{};
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+                return false;
+            }
+            stream.next_in = const_cast<Bytef*>(input);
+            stream.avail_in = entry.compressed_size;
+            stream.next_out = output;
+            stream.avail_out = static_cast<uInt>(size);
+            int result = inflate(&stream, Z_FINISH);
+            size_t written = stream.total_out;
+            inflateEnd(&stream);
+
+            // A truncated output stops with Z_BUF_ERROR, the CRC covers the whole entry then
+            bool complete = result == Z_STREAM_END && written == entry.size;
+            bool truncated = result == Z_BUF_ERROR && size < entry.size && written == size;
+            return (complete && crc32(0, output, static_cast<uInt>(written)) == entry.crc) || truncated;
+        }
+#endif
+        fmt::println("{}: compression method {} is not supported", entry.name, entry.method);
+        return false;
+    }
+
+    bool read_archive_entry(const RomArchive& archive, size_t index, std::vector<uint8_t>& rom) {
+        const ArchiveEntry& entry = archive.entries[index];
+        // Bounded by index_zip/index_tar, clamped again before allocating from a size read in the archive
+        rom.resize(std::min<size_t>(entry.size, rom_capacity(Platform::MEGACHIP)));
+        if (!inflate_entry(archive, entry, rom.data(), rom.size())) {
+            rom.clear();
+            return false;
+        }
+        return true;
+    }
+
+    template <typename State>
+    static bool load_entry(const RomArchive& archive, size_t index, State& state) {
+        const ArchiveEntry& entry = archive.entries[index];
+        reset_state(state);
+        // ROMs larger than the memory after 0x200 are truncated, as by load_rom_from_buffer
+        bool ok = inflate_entry(archive, entry, state.memory + C8_START_ADDRESS, State::memory_size - C8_START_ADDRESS);
+        if (!ok) {
+            reset_state(state);
+        }
+        rehash_state(state);
+        return ok;
+    }
+
+    bool load_archive_entry(const RomArchive& archive, size_t index, CHIP8EmulatorState& state) {
+        return load_entry(archive, index, state);
+    }
+
+    bool load_archive_entry(const RomArchive& archive, size_t index, XOCHIPState& state) {
+        return load_entry(archive, index, state);
+    }
+
+    bool load_archive_entry(const RomArchive& archive, size_t index, MegaChipState& state) {
+        return load_entry(archive, index, state);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "rom_file.h"
+
+namespace chip8 {
+
+    enum class ArchiveFormat : uint8_t {
+        Zip = 0,
+        Tar = 1,
+    };
+
+    // Storage of a zip entry, tar entries are always stored
+    enum ArchiveMethod : uint16_t {
+        ARCHIVE_STORED = 0,
+        ARCHIVE_DEFLATED = 8,
+    };
+
+    struct ArchiveEntry {
+        std::string name;
+        // Offset of the entry bytes in the archive
+        uint64_t offset;
+        uint32_t compressed_size;
+        uint32_t size;
+        uint32_t crc;
+        uint16_t method;
+    };
+
+    // ROM pack read in place from a mapped .zip or .tar, nothing is extracted to disk
+    //
+    // The index of the entries is built once when the archive is opened (from the central directory
+    // of a zip, by walking the headers of a tar) and sorted by name: any ROM is then found by a
+    // binary search and read without going through the others.
+    struct RomArchive {
+        RomFile file;
+        ArchiveFormat format{};
+        // .ch8/.sc8/.xo8 entries only, sorted by name
+        std::vector<ArchiveEntry> entries;
+    };
+
+    // Returns false (and prints why) if the file cannot be mapped or is neither a zip nor a tar
+    bool open_rom_archive(RomArchive& archive, const char* filename);
+
+    void close_rom_archive(RomArchive& archive);
+
+    // Index of the entry, -1 if it is not in the archive
+    int find_archive_entry(const RomArchive& archive, const std::string& name);
+
+    // Bytes of a stored entry, straight from the mapping (nullptr if the entry is compressed)
+    const uint8_t* archive_entry_data(const RomArchive& archive, size_t index);
+
+    // Decompress (or copy) the entry into rom, false if it is corrupted or its method is not supported
+    // Deflated entries need zlib (CHIP8_HAVE_ZLIB).
+    bool read_archive_entry(const RomArchive& archive, size_t index, std::vector<uint8_t>& rom);
+
+    // Same as load_rom_from_buffer, decompressing the entry directly into the memory of the state
+    bool load_archive_entry(const RomArchive& archive, size_t index, CHIP8EmulatorState& state);
+    bool load_archive_entry(const RomArchive& archive, size_t index, XOCHIPState& state);
+    bool load_archive_entry(const RomArchive& archive, size_t index, MegaChipState& state);
+}
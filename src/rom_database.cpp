@@ -0,0 +1,85 @@
+#include "rom_database.h"
+
+#include <iterator>
+
+namespace chip8 {
+
+    static constexpr uint8_t N = ROM_NO_KEY;
+
+    // Bundled database, sorted by hash (checked below)
+    // Keys: up, down, left, right, action
+    //
+    // The ROMs of data/roms keep the quirks they are known to run with here (Default), the Octo
+    // ROMs of data/octo expect Octo's (XOChip).
+    static constexpr RomInfo ROM_DATABASE[] = {
+        {0x0013d578c391c5c2ull, "LUNAR_LANDER", Platform::CHIP8, QuirkProfile::Default, 10, {0x2, N, 0x4, 0x6, N}},
+        {0x0c0661c41322f5ccull, "test_opcode",  Platform::CHIP8, QuirkProfile::Default, 10, {N, N, N, N, N}},
+        {0x0d1a1f0c779f2c0bull, "heart_monitor", Platform::CHIP8, QuirkProfile::XOChip, 15, {N, N, N, N, N}},
+        {0x10fd5ed5c2c5f9b5ull, "INVADERS",     Platform::CHIP8, QuirkProfile::Default, 15, {N, N, 0x4, 0x6, 0x5}},
+        {0x34de57eaf1c197b2ull, "UFO",          Platform::CHIP8, QuirkProfile::Default, 10, {N, N, 0x4, 0x6, 0x5}},
+        {0x378f99c3f0100021ull, "TETRIS",       Platform::CHIP8, QuirkProfile::Default, 10, {0x4, 0x7, 0x5, 0x6, N}},
+        {0x3ba9abb3d67eaee8ull, "ASTRO_DODGE",  Platform::CHIP8, QuirkProfile::Default, 15, {0x2, 0x8, 0x4, 0x6, 0x5}},
+        {0x412ee5eb7d331299ull, "WIPEOFF",      Platform::CHIP8, QuirkProfile::Default, 10, {N, N, 0x4, 0x6, N}},
+        {0x4a9366bd31161e45ull, "PUZZLE",       Platform::CHIP8, QuirkProfile::Default, 10, {N, N, N, N, N}},
+        {0x4cbe8bbd65f9c297ull, "TANK",         Platform::CHIP8, QuirkProfile::Default, 10, {0x2, 0x8, 0x4, 0x6, 0x5}},
+        {0x581201b532a14b57ull, "PONG",         Platform::CHIP8, QuirkProfile::Default, 10, {0x1, 0x4, N, N, N}},
+        {0x646282d744e7aa1aull, "BLINKY",       Platform::CHIP8, QuirkProfile::Default, 15, {0x3, 0x6, 0x7, 0x8, N}},
+        {0x6f6010f632d4c0bbull, "SYZYGY",       Platform::CHIP8, QuirkProfile::Default, 15, {0x3, 0x6, 0x7, 0x8, N}},
+        {0x8e7d4168a0f0f769ull, "chipquarium",  Platform::CHIP8, QuirkProfile::XOChip, 20, {N, N, N, N, N}},
+        {0xb8642603db10d329ull, "VERS",         Platform::CHIP8, QuirkProfile::Default, 10, {N, N, N, N, N}},
+        {0xbdbbfac9c70a97f5ull, "MISSILE",      Platform::CHIP8, QuirkProfile::Default, 10, {N, N, N, N, 0x8}},
+        {0xcaf3771821af0a96ull, "GUESS",        Platform::CHIP8, QuirkProfile::Default, 10, {N, N, N, N, N}},
+        {0xd5b5ff7f6601e0f5ull, "PONG2",        Platform::CHIP8, QuirkProfile::Default, 10, {0x1, 0x4, N, N, N}},
+        {0xea32806969a479ecull, "MAZE",         Platform::CHIP8, QuirkProfile::Default, 10, {N, N, N, N, N}},
+    };
+
+    static constexpr bool is_sorted_by_hash(const RomInfo* entries, size_t count) {
+        for (size_t i = 1; i < count; i++) {
+            if (entries[i - 1].hash >= entries[i].hash) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert(is_sorted_by_hash(ROM_DATABASE, std::size(ROM_DATABASE)),
+                  "ROM_DATABASE must be sorted by hash, without duplicates");
+
+    static inline uint64_t mix_rom_word(uint64_t h, uint64_t word) {
+        h ^= word * 0x9E3779B97F4A7C15ull;
+        h = (h << 31) | (h >> 33);
+        return h * 0xC2B2AE3D27D4EB4Full;
+    }
+
+    // Words are read in the host byte order: the hashes of the database assume a little-endian host
+    uint64_t hash_rom(const uint8_t* rom, size_t size) {
+        uint64_t h = 0xCBF29CE484222325ull ^ (size * 0x9E3779B97F4A7C15ull);
+
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, &rom[i], sizeof(word));
+            h = mix_rom_word(h, word);
+        }
+        uint64_t tail = 0;
+        if (i < size) {
+            memcpy(&tail, &rom[i], size - i);
+        }
+        h = mix_rom_word(h, tail);
+
+        // splitmix64 finalizer
+        h ^= h >> 30;
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 27;
+        h *= 0x94D049BB133111EBull;
+        return h ^ (h >> 31);
+    }
+
+    const RomInfo* find_rom_info(const uint8_t* rom, size_t size) {
+        const uint64_t hash = hash_rom(rom, size);
+        const RomInfo* end = ROM_DATABASE + std::size(ROM_DATABASE);
+        const RomInfo* info = std::lower_bound(ROM_DATABASE, end, hash,
+                                               [](const RomInfo& entry, uint64_t h) { return entry.hash < h; });
+        return info != end && info->hash == hash ? info : nullptr;
+    }
+}
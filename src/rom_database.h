@@ -0,0 +1,42 @@
+#pragma once
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    // Host keys a ROM can bind on top of the keypad layout (KEYMAP in app.h)
+    enum RomKey : uint8_t {
+        ROM_KEY_UP = 0,
+        ROM_KEY_DOWN = 1,
+        ROM_KEY_LEFT = 2,
+        ROM_KEY_RIGHT = 3,
+        ROM_KEY_ACTION = 4,
+        ROM_KEY_COUNT = 5,
+    };
+
+    // No CHIP-8 key bound
+    const uint8_t ROM_NO_KEY = 0xFF;
+
+    // Settings a ROM needs to run as intended
+    struct RomInfo {
+        // hash_rom of the ROM image
+        uint64_t hash;
+        const char* name;
+
+        Platform platform;
+        QuirkProfile quirks;
+
+        // Instructions per frame (C8_FRAME_RATE frames per second)
+        uint16_t cycles_per_frame;
+
+        // CHIP-8 key bound to each RomKey, ROM_NO_KEY if none
+        uint8_t keys[ROM_KEY_COUNT];
+    };
+
+    // 64-bit non-cryptographic hash of a ROM image (8 bytes at a time)
+    uint64_t hash_rom(const uint8_t* rom, size_t size);
+
+    // Entry of the bundled database for the ROM, nullptr if the ROM is unknown
+    // The database is a sorted array in the read-only data of the executable: a binary search, no I/O.
+    const RomInfo* find_rom_info(const uint8_t* rom, size_t size);
+}
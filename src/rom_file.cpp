@@ -0,0 +1,96 @@
+#include "rom_file.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+namespace chip8 {
+
+#ifdef __linux__
+    static std::shared_ptr<const uint8_t> map_file(const char* filename, size_t& size) {
+        int fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+            close(fd);
+            return nullptr;
+        }
+        size = static_cast<size_t>(info.st_size);
+
+        // The mapping stays valid once the descriptor is closed
+        void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+        // ROMs are read once from start to end
+        madvise(memory, size, MADV_SEQUENTIAL);
+
+        return std::shared_ptr<const uint8_t>(static_cast<const uint8_t*>(memory),
+                                              [size](const uint8_t* data) {
+                                                  munmap(const_cast<uint8_t*>(data), size);
+                                              });
+    }
+#else
+    static std::shared_ptr<const uint8_t> map_file(const char* filename, size_t& size) {
+        std::ifstream stream(filename, std::ios::binary | std::ios::ate);
+        if (!stream.is_open()) {
+            return nullptr;
+        }
+        std::streamsize length = stream.tellg();
+        if (length <= 0) {
+            return nullptr;
+        }
+        size = static_cast<size_t>(length);
+        stream.seekg(0, std::ios::beg);
+
+        std::shared_ptr<uint8_t> buffer(new uint8_t[size], std::default_delete<uint8_t[]>());
+        if (!stream.read(reinterpret_cast<char*>(buffer.get()), length)) {
+            return nullptr;
+        }
+        return buffer;
+    }
+#endif
+
+    bool map_rom_file(RomFile& file, const char* filename) {
+        file = RomFile{};
+
+        size_t size = 0;
+        std::shared_ptr<const uint8_t> mapping = map_file(filename, size);
+        if (!mapping) {
+            fmt::println("Cannot read the ROM {}", filename);
+            return false;
+        }
+
+        file.data = mapping.get();
+        file.size = size;
+        file.mapping = std::move(mapping);
+        return true;
+    }
+
+    bool open_rom_file(RomFile& file, const char* filename, Platform platform) {
+        if (!map_rom_file(file, filename)) {
+            return false;
+        }
+
+        if (file.size > rom_capacity(platform)) {
+            fmt::println("ROM size ({} bytes) is bigger than the {} memory ({} bytes available)",
+                         file.size, platform_name(platform), rom_capacity(platform));
+            close_rom_file(file);
+            return false;
+        }
+        return true;
+    }
+
+    void close_rom_file(RomFile& file) {
+        file = RomFile{};
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+
+#include "emulator.h"
+#include "xochip.h"
+#include "megachip.h"
+
+namespace chip8 {
+
+    // ROM file mapped read-only in memory (a heap copy where mmap is not available)
+    //
+    // The mapping is reference counted: the ROM pages of a snapshot built from the file
+    // (create_rom_image in population.h) point into it and keep it alive after close_rom_file.
+    struct RomFile {
+        const uint8_t* data{};
+        size_t size{};
+        std::shared_ptr<const uint8_t> mapping;
+    };
+
+    // Largest ROM the platform can load: its memory after C8_START_ADDRESS
+    constexpr size_t rom_capacity(Platform platform) {
+        switch (platform) {
+            case Platform::XOCHIP:   return XO_MEMORY_SIZE - C8_START_ADDRESS;
+            case Platform::MEGACHIP: return MC_MEMORY_SIZE - C8_START_ADDRESS;
+            default:                 return C8_MEMORY_SIZE - C8_START_ADDRESS;
+        }
+    }
+
+    // Map the file and check it fits in the memory of the platform. Returns false (and prints why)
+    // if the file cannot be read, is empty or is too big, the RomFile is left empty then.
+    bool open_rom_file(RomFile& file, const char* filename, Platform platform = Platform::CHIP8);
+
+    // Map the file whatever its size (ROM packs, see rom_archive.h)
+    bool map_rom_file(RomFile& file, const char* filename);
+
+    // Release this reference to the mapping
+    void close_rom_file(RomFile& file);
+}
@@ -0,0 +1,291 @@
+#include "rom_library.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+#include "xochip.h"
+#include "megachip.h"
+#include "rom_analysis.h"
+#include "rom_database.h"
+#include "rom_file.h"
+
+namespace chip8 {
+
+    namespace fs = std::filesystem;
+
+    // Files handed out to a worker at once, ROM runs are long enough for a small chunk
+    const size_t LIB_CHUNK_SIZE = 4;
+
+    static bool is_rom_extension(const fs::path& path) {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".ch8" || extension == ".sc8" || extension == ".xo8";
+    }
+
+    bool load_rom_library(RomLibrary& library, const char* filename) {
+        library.entries.clear();
+
+        FILE* file = fopen(filename, "rb");
+        if (!file) {
+            return false;
+        }
+
+        uint32_t header[3];
+        bool ok = fread(header, sizeof(header), 1, file) == 1
+                  && header[0] == LIB_INDEX_MAGIC && header[1] == LIB_INDEX_VERSION;
+
+        if (ok) {
+            // The count is not trusted: every entry is pushed once it is read, a truncated or corrupted
+            // index fails on a short read instead of allocating its count up front
+            for (uint32_t i = 0; i < header[2]; i++) {
+                RomIndexEntry entry;
+                ok = fread(&entry.record, sizeof(entry.record), 1, file) == 1;
+                if (!ok) {
+                    break;
+                }
+                entry.path.resize(entry.record.path_size);
+                ok = fread(entry.path.data(), 1, entry.path.size(), file) == entry.path.size();
+                if (!ok) {
+                    break;
+                }
+                library.entries.push_back(std::move(entry));
+            }
+        }
+        fclose(file);
+
+        if (!ok) {
+            library.entries.clear();
+            return false;
+        }
+        std::sort(library.entries.begin(), library.entries.end(),
+                  [](const RomIndexEntry& a, const RomIndexEntry& b) { return a.path < b.path; });
+        return true;
+    }
+
+    bool save_rom_library(const RomLibrary& library, const char* filename) {
+        std::string temporary = std::string(filename) + ".tmp";
+        FILE* file = fopen(temporary.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+
+        uint32_t header[3] = {LIB_INDEX_MAGIC, LIB_INDEX_VERSION, static_cast<uint32_t>(library.entries.size())};
+        bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+        for (const RomIndexEntry& entry : library.entries) {
+            if (!ok) {
+                break;
+            }
+            ok = fwrite(&entry.record, sizeof(entry.record), 1, file) == 1
+                 && fwrite(entry.path.data(), 1, entry.path.size(), file) == entry.path.size();
+        }
+        ok = fclose(file) == 0 && ok;
+
+        std::error_code error;
+        if (ok) {
+            fs::rename(temporary, filename, error);
+        }
+        if (!ok || error) {
+            fs::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+
+    // Lit pixel of each state type (CHIP-8 bit, XO-CHIP colour index, MEGA-CHIP ARGB colour)
+    static bool is_lit(bool pixel) { return pixel; }
+    static bool is_lit(uint8_t index) { return index != 0; }
+    static bool is_lit(uint32_t colour) { return (colour & 0x00FFFFFFu) != 0; }
+
+    // Sample the display at the centre of each thumbnail pixel
+    template <typename State>
+    static void capture_thumbnail(const State& state, RomIndexRecord& record) {
+        unsigned int width = display_width(state);
+        unsigned int height = display_height(state);
+        for (unsigned int y = 0; y < LIB_THUMBNAIL_HEIGHT; y++) {
+            uint64_t row = 0;
+            unsigned int sy = (2 * y + 1) * height / (2 * LIB_THUMBNAIL_HEIGHT);
+            for (unsigned int x = 0; x < LIB_THUMBNAIL_WIDTH; x++) {
+                unsigned int sx = (2 * x + 1) * width / (2 * LIB_THUMBNAIL_WIDTH);
+                row |= static_cast<uint64_t>(is_lit(get_pixel(state, sx, sy))) << (63 - x);
+            }
+            record.thumbnail[y] = row;
+        }
+    }
+
+    // Run the ROM from reset without inputs, counting the executed instructions by first nibble
+    template <typename State>
+    static void run_headless(State& state, const RomFile& file, RomIndexRecord& record, unsigned int nb_frames) {
+        load_rom_from_buffer(state, const_cast<uint8_t*>(file.data), static_cast<int>(file.size));
+        state.quirks = record.quirks;
+        // Same run on every indexing of the same file
+        seed_random(state, record.hash);
+
+        const unsigned int mask = State::memory_size - 1;
+        for (unsigned int f = 0; f < nb_frames; f++) {
+            for (unsigned int i = 0; i < record.cycles_per_frame; i++) {
+                record.opcode_mix[state.memory[state.pc & mask] >> 4] += 1;
+                emulate_cycle(state);
+            }
+            update_timers(state);
+        }
+
+        capture_thumbnail(state, record);
+    }
+
+    // Work states of a worker, the XO-CHIP and MEGA-CHIP ones are only allocated if needed
+    struct LibraryWorker {
+        CHIP8EmulatorState chip8 = create_chip8emulator();
+        std::unique_ptr<XOCHIPState> xochip;
+        std::unique_ptr<MegaChipState> megachip;
+    };
+
+    static bool index_rom(LibraryWorker& worker, RomIndexEntry& entry, unsigned int nb_frames) {
+        RomFile file;
+        // Any size a platform can load, the platform is only known once the ROM is analyzed
+        if (!open_rom_file(file, entry.path.c_str(), Platform::MEGACHIP)) {
+            return false;
+        }
+
+        RomIndexRecord& record = entry.record;
+        record.hash = hash_rom(file.data, file.size);
+        if (const RomInfo* info = find_rom_info(file.data, file.size)) {
+            record.platform = info->platform;
+            record.quirks = info->quirks;
+            record.cycles_per_frame = info->cycles_per_frame;
+            record.known = 1;
+        } else {
+            RomAnalysis analysis = analyze_rom(file.data, file.size);
+            record.platform = analysis.platform;
+            record.quirks = analysis.quirks;
+            record.cycles_per_frame = LIB_DEFAULT_CYCLES_PER_FRAME;
+            record.known = 0;
+        }
+
+        if (file.size > rom_capacity(record.platform)) {
+            close_rom_file(file);
+            return false;
+        }
+
+        switch (record.platform) {
+            case Platform::XOCHIP:
+                if (!worker.xochip) {
+                    worker.xochip.reset(new XOCHIPState);
+                }
+                create_xochip(*worker.xochip);
+                run_headless(*worker.xochip, file, record, nb_frames);
+                break;
+            case Platform::MEGACHIP:
+                if (!worker.megachip) {
+                    worker.megachip.reset(new MegaChipState);
+                }
+                create_megachip(*worker.megachip);
+                run_headless(*worker.megachip, file, record, nb_frames);
+                break;
+            default:
+                run_headless(worker.chip8, file, record, nb_frames);
+                break;
+        }
+
+        close_rom_file(file);
+        return true;
+    }
+
+    RomLibraryStats index_rom_library(RomLibrary& library, const char* directory, const RomLibraryConfig& config) {
+        auto start = std::chrono::steady_clock::now();
+        RomLibraryStats stats;
+
+        // Files currently in the directory, sorted by path as the entries
+        std::vector<RomIndexEntry> files;
+        std::error_code error;
+        for (auto it = fs::recursive_directory_iterator(directory, fs::directory_options::skip_permission_denied, error);
+             it != fs::recursive_directory_iterator(); it.increment(error)) {
+            if (error) {
+                break;
+            }
+            if (!it->is_regular_file(error) || !is_rom_extension(it->path())) {
+                continue;
+            }
+            RomIndexEntry file;
+            file.path = it->path().lexically_normal().string();
+            file.record.size = it->file_size(error);
+            file.record.mtime = it->last_write_time(error).time_since_epoch().count();
+            if (!error && file.path.size() <= UINT16_MAX) {
+                file.record.path_size = static_cast<uint16_t>(file.path.size());
+                files.push_back(std::move(file));
+            }
+        }
+        std::sort(files.begin(), files.end(),
+                  [](const RomIndexEntry& a, const RomIndexEntry& b) { return a.path < b.path; });
+
+        // Keep the entries of the files unchanged since the last indexing
+        std::vector<size_t> pending;
+        size_t nb_still_present = 0;
+        for (size_t i = 0; i < files.size(); i++) {
+            const RomIndexEntry* previous = find_library_entry(library, files[i].path);
+            nb_still_present += previous != nullptr;
+            if (previous && previous->record.size == files[i].record.size && previous->record.mtime == files[i].record.mtime) {
+                files[i].record = previous->record;
+                stats.unchanged += 1;
+            } else {
+                pending.push_back(i);
+            }
+        }
+        stats.removed = library.entries.size() - nb_still_present;
+
+        // Run the others, each worker takes the next chunk of files
+        unsigned int nb_workers = config.nb_workers ? config.nb_workers : std::thread::hardware_concurrency();
+        nb_workers = static_cast<unsigned int>(std::clamp<size_t>((pending.size() + LIB_CHUNK_SIZE - 1) / LIB_CHUNK_SIZE, 1, std::max(nb_workers, 1u)));
+        unsigned int nb_frames = config.nb_seconds * C8_FRAME_RATE;
+
+        std::vector<uint8_t> indexed(files.size(), 1);
+        std::atomic<size_t> next{0};
+        auto work = [&]() {
+            auto worker = std::make_unique<LibraryWorker>();
+            while (true) {
+                size_t begin = next.fetch_add(LIB_CHUNK_SIZE, std::memory_order_relaxed);
+                if (begin >= pending.size()) {
+                    break;
+                }
+                size_t end = std::min(begin + LIB_CHUNK_SIZE, pending.size());
+                for (size_t p = begin; p < end; p++) {
+                    indexed[pending[p]] = index_rom(*worker, files[pending[p]], nb_frames);
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int t = 1; t < nb_workers; t++) {
+            threads.emplace_back(work);
+        }
+        work();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        library.entries.clear();
+        for (size_t i = 0; i < files.size(); i++) {
+            if (indexed[i]) {
+                library.entries.push_back(std::move(files[i]));
+            } else {
+                stats.failed += 1;
+            }
+        }
+        stats.indexed = pending.size() - stats.failed;
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+    const RomIndexEntry* find_library_entry(const RomLibrary& library, const std::string& path) {
+        auto it = std::lower_bound(library.entries.begin(), library.entries.end(), path,
+                                   [](const RomIndexEntry& entry, const std::string& key) { return entry.path < key; });
+        return it != library.entries.end() && it->path == path ? &*it : nullptr;
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    // Index file: "C8LB", version, number of entries, then per entry a RomIndexRecord followed by its
+    // path (path_size bytes, no terminator). Host byte order, the index is a local cache.
+    const uint32_t LIB_INDEX_MAGIC = 0x424C3843;
+    const uint32_t LIB_INDEX_VERSION = 1;
+
+    // Relative to the working directory, written by `CHIP8 --index <directory>` and read by the GUI at start up
+    const char* const LIB_DEFAULT_INDEX = "chip8_library.idx";
+
+    // Thumbnails are the display scaled to 64 x 32, one bit per pixel
+    const unsigned int LIB_THUMBNAIL_WIDTH = 64;
+    const unsigned int LIB_THUMBNAIL_HEIGHT = 32;
+
+    // Headless run of each ROM, the thumbnail is the last frame
+    const unsigned int LIB_DEFAULT_SECONDS = 3;
+    // Speed of the ROMs missing from the ROM database
+    const unsigned int LIB_DEFAULT_CYCLES_PER_FRAME = 10;
+
+    // Fixed-size part of an index entry, as stored in the file
+    struct RomIndexRecord {
+        // Last write time (file clock ticks) and size of the file when it was indexed
+        int64_t mtime;
+        uint64_t size;
+        // hash_rom of the file
+        uint64_t hash;
+
+        // Instructions executed during the headless run, by first nibble (0NNN .. FNNN)
+        uint32_t opcode_mix[16];
+        // Row y, bit 63 - x
+        uint64_t thumbnail[LIB_THUMBNAIL_HEIGHT];
+
+        // Platform and quirks the ROM was run with: its ROM database entry or analyze_rom
+        Platform platform;
+        QuirkProfile quirks;
+        // Found in the ROM database
+        uint8_t known;
+        uint8_t padding;
+        uint16_t path_size;
+        uint16_t cycles_per_frame;
+    };
+
+    static_assert(sizeof(RomIndexRecord) == 3 * 8 + 16 * 4 + LIB_THUMBNAIL_HEIGHT * 8 + 8,
+                  "RomIndexRecord is written as is, it must not hold implicit padding");
+
+    struct RomIndexEntry {
+        std::string path;
+        RomIndexRecord record{};
+    };
+
+    // Entries sorted by path
+    struct RomLibrary {
+        std::vector<RomIndexEntry> entries;
+    };
+
+    struct RomLibraryConfig {
+        // Length of the headless run
+        unsigned int nb_seconds{LIB_DEFAULT_SECONDS};
+        // 0 uses every hardware thread
+        unsigned int nb_workers{};
+    };
+
+    struct RomLibraryStats {
+        // Files run this time: new ones and the ones whose size or mtime changed
+        size_t indexed{};
+        // Files whose entry was kept as is
+        size_t unchanged{};
+        // Entries of files no longer in the directory
+        size_t removed{};
+        // Files that could not be read or do not fit in any platform
+        size_t failed{};
+        double seconds{};
+    };
+
+    // Returns false if the file cannot be read or is not an index of this version, the library is
+    // left empty then
+    bool load_rom_library(RomLibrary& library, const char* filename);
+
+    // Written to filename.tmp then renamed: a reader never sees a partial index
+    bool save_rom_library(const RomLibrary& library, const char* filename);
+
+    // Bring the library up to date with the .ch8/.sc8/.xo8 files under directory (recursively)
+    // Only the new and modified files are run, on nb_workers threads. The entries of the files no
+    // longer there are dropped.
+    RomLibraryStats index_rom_library(RomLibrary& library, const char* directory, const RomLibraryConfig& config = {});
+
+    // nullptr if path is not in the library
+    const RomIndexEntry* find_library_entry(const RomLibrary& library, const std::string& path);
+
+    inline bool get_thumbnail_pixel(const RomIndexRecord& record, unsigned int x, unsigned int y) {
+        return (record.thumbnail[y] >> (63 - x)) & 0b1;
+    }
+}
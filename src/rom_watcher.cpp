@@ -0,0 +1,86 @@
+#include "rom_watcher.h"
+
+#include <filesystem>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace chip8 {
+
+    namespace fs = std::filesystem;
+
+    static int64_t last_write_time(const std::string& path) {
+        std::error_code error;
+        auto time = fs::last_write_time(path, error);
+        return error ? 0 : time.time_since_epoch().count();
+    }
+
+    bool create_rom_watcher(RomWatcher& watcher, const char* filename) {
+        destroy_rom_watcher(watcher);
+
+        fs::path path(filename);
+        watcher.directory = path.has_parent_path() ? path.parent_path().string() : ".";
+        watcher.name = path.filename().string();
+        watcher.mtime = last_write_time(filename);
+
+#ifdef __linux__
+        watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watcher.fd < 0) {
+            return false;
+        }
+        watcher.watch = inotify_add_watch(watcher.fd, watcher.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watcher.watch < 0) {
+            destroy_rom_watcher(watcher);
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    bool poll_rom_watcher(RomWatcher& watcher) {
+#ifdef __linux__
+        if (watcher.fd < 0) {
+            return false;
+        }
+
+        // Every pending event is drained, a save usually comes as several of them
+        bool changed = false;
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(watcher.fd, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + length; ) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                if (event->len && watcher.name == event->name) {
+                    changed = true;
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        return changed;
+#else
+        if (watcher.name.empty()) {
+            return false;
+        }
+        int64_t mtime = last_write_time((fs::path(watcher.directory) / watcher.name).string());
+        bool changed = mtime != watcher.mtime;
+        watcher.mtime = mtime;
+        return changed;
+#endif
+    }
+
+    void destroy_rom_watcher(RomWatcher& watcher) {
+#ifdef __linux__
+        if (watcher.fd >= 0) {
+            // Closing the descriptor removes the watch
+            close(watcher.fd);
+        }
+#endif
+        watcher.fd = -1;
+        watcher.watch = -1;
+        watcher.directory.clear();
+        watcher.name.clear();
+        watcher.mtime = 0;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    // Notifies the rewrites of one ROM file
+    //
+    // On Linux the directory of the file is watched with inotify (editors and assemblers often write
+    // a new file and rename it over the old one, a watch on the file itself would be lost), polling
+    // is a non-blocking read. Elsewhere the last write time is compared on every poll.
+    struct RomWatcher {
+        std::string directory;
+        std::string name;
+
+        int fd{-1};
+        int watch{-1};
+        // Non-Linux fallback
+        int64_t mtime{};
+    };
+
+    bool create_rom_watcher(RomWatcher& watcher, const char* filename);
+
+    // True if the file was written (and closed) or replaced since the last poll
+    bool poll_rom_watcher(RomWatcher& watcher);
+
+    void destroy_rom_watcher(RomWatcher& watcher);
+}
@@ -0,0 +1,256 @@
+#include "scheduler.h"
+
+#include <chrono>
+
+namespace chip8 {
+
+    enum class StealResult {
+        Success,
+        Empty,
+        Contended,
+    };
+
+    // Owner side: take the most recently distributed range
+    static bool take(WorkDeque& deque, InstanceRange& range) {
+        int64_t b = deque.bottom.load(std::memory_order_relaxed) - 1;
+        deque.bottom.store(b, std::memory_order_seq_cst);
+        int64_t t = deque.top.load(std::memory_order_seq_cst);
+
+        if (t > b) {
+            deque.bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        range = deque.ranges[b];
+        if (t == b) {
+            // Last range, race against the thieves for it
+            bool won = deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst);
+            deque.bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Thief side: take the oldest range
+    static StealResult steal(WorkDeque& deque, InstanceRange& range) {
+        int64_t t = deque.top.load(std::memory_order_seq_cst);
+        int64_t b = deque.bottom.load(std::memory_order_seq_cst);
+        if (t >= b) {
+            return StealResult::Empty;
+        }
+
+        range = deque.ranges[t];
+        if (!deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst)) {
+            return StealResult::Contended;
+        }
+        return StealResult::Success;
+    }
+
+    // Visit the other workers until a range is stolen or every deque is empty
+    static bool steal_any(InstanceScheduler& scheduler, SchedulerWorker& worker, InstanceRange& range) {
+        const size_t nb_workers = scheduler.workers.size();
+
+        bool retry = true;
+        while (retry) {
+            retry = false;
+            for (size_t k = 1; k < nb_workers; k++) {
+                SchedulerWorker& victim = *scheduler.workers[(worker.id + k) % nb_workers];
+                switch (steal(victim.deque, range)) {
+                    case StealResult::Success:
+                        worker.steals += 1;
+                        return true;
+                    case StealResult::Contended:
+                        retry = true;
+                        break;
+                    case StealResult::Empty:
+                        break;
+                }
+            }
+        }
+        return false;
+    }
+
+    static void run_range(InstanceScheduler& scheduler, SchedulerWorker& worker, InstanceRange range, unsigned int nb_frames) {
+        const bool detect = scheduler.detect_cycles;
+
+        for (size_t i = range.begin; i < range.end; i++) {
+            CHIP8EmulatorState& state = scheduler.instances[i];
+            for (unsigned int f = 0; f < nb_frames; f++) {
+                if (detect) {
+                    CycleDetector& detector = scheduler.detectors[i];
+                    watch_cycle_input(detector, state);
+                    if (detector.found) {
+                        break;
+                    }
+                }
+
+                worker.cycles += worker.frame_cache ? emulate_frame_cached(*worker.frame_cache, state, scheduler.cycles_per_frame)
+                                                    : emulate_frame(state, scheduler.cycles_per_frame);
+                worker.frames += 1;
+
+                if (detect && update_cycle_detector(scheduler.detectors[i], state, scheduler.cycles_per_frame)) {
+                    break;
+                }
+            }
+        }
+        worker.tasks += 1;
+    }
+
+    static void worker_loop(InstanceScheduler& scheduler, SchedulerWorker& worker) {
+        uint64_t tick = 0;
+        while (true) {
+            unsigned int nb_frames;
+            {
+                std::unique_lock<std::mutex> lock(scheduler.mutex);
+                scheduler.tick_started.wait(lock, [&] { return scheduler.quit || scheduler.tick != tick; });
+                if (scheduler.quit) {
+                    return;
+                }
+                tick = scheduler.tick;
+                nb_frames = scheduler.frames_per_tick;
+            }
+
+            InstanceRange range;
+            while (take(worker.deque, range) || steal_any(scheduler, worker, range)) {
+                run_range(scheduler, worker, range, nb_frames);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(scheduler.mutex);
+                scheduler.workers_done += 1;
+                if (scheduler.workers_done == scheduler.workers.size()) {
+                    scheduler.tick_finished.notify_one();
+                }
+            }
+        }
+    }
+
+    bool create_scheduler(InstanceScheduler& scheduler, unsigned int nb_workers, unsigned int cycles_per_frame) {
+        if (nb_workers == 0) {
+            nb_workers = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        scheduler.cycles_per_frame = cycles_per_frame;
+        scheduler.workers.clear();
+        for (unsigned int i = 0; i < nb_workers; i++) {
+            auto worker = std::make_unique<SchedulerWorker>();
+            worker->id = i;
+            scheduler.workers.push_back(std::move(worker));
+        }
+        for (auto& worker : scheduler.workers) {
+            worker->thread = std::thread(worker_loop, std::ref(scheduler), std::ref(*worker));
+        }
+        return true;
+    }
+
+    void enable_frame_cache(InstanceScheduler& scheduler, size_t nb_entries) {
+        for (auto& worker : scheduler.workers) {
+            if (nb_entries == 0) {
+                worker->frame_cache.reset();
+                continue;
+            }
+            worker->frame_cache = std::make_unique<FrameCache>();
+            create_frame_cache(*worker->frame_cache, nb_entries);
+        }
+    }
+
+    void enable_cycle_detection(InstanceScheduler& scheduler) {
+        scheduler.detect_cycles = true;
+        scheduler.detectors.clear();
+        scheduler.detectors.reserve(scheduler.instances.size());
+        for (const CHIP8EmulatorState& state : scheduler.instances) {
+            scheduler.detectors.push_back(create_cycle_detector(state));
+        }
+    }
+
+    size_t add_instance(InstanceScheduler& scheduler, const CHIP8EmulatorState& state) {
+        scheduler.instances.push_back(state);
+        if (scheduler.detect_cycles) {
+            scheduler.detectors.push_back(create_cycle_detector(state));
+        }
+        return scheduler.instances.size() - 1;
+    }
+
+    void restart_instance(InstanceScheduler& scheduler, size_t index) {
+        if (scheduler.detect_cycles) {
+            scheduler.detectors[index] = create_cycle_detector(scheduler.instances[index]);
+        }
+    }
+
+    // Split the instances in chunks and give each worker a contiguous block of them.
+    // Workers running out of work steal the remaining chunks of the others.
+    static void distribute(InstanceScheduler& scheduler) {
+        const size_t nb_workers = scheduler.workers.size();
+        const size_t nb_instances = scheduler.instances.size();
+        const size_t nb_chunks = (nb_instances + SCHEDULER_CHUNK_SIZE - 1) / SCHEDULER_CHUNK_SIZE;
+
+        for (size_t w = 0; w < nb_workers; w++) {
+            WorkDeque& deque = scheduler.workers[w]->deque;
+            deque.ranges.clear();
+
+            size_t first = nb_chunks * w / nb_workers;
+            size_t last = nb_chunks * (w + 1) / nb_workers;
+            // Taken from the bottom: push in reverse so the owner walks the memory forward
+            for (size_t c = last; c > first; c--) {
+                size_t begin = (c - 1) * SCHEDULER_CHUNK_SIZE;
+                size_t end = std::min(begin + SCHEDULER_CHUNK_SIZE, nb_instances);
+                deque.ranges.push_back({begin, end});
+            }
+
+            deque.top.store(0, std::memory_order_relaxed);
+            deque.bottom.store(static_cast<int64_t>(deque.ranges.size()), std::memory_order_relaxed);
+        }
+    }
+
+    void run_scheduler_tick(InstanceScheduler& scheduler, unsigned int nb_frames) {
+        auto start = std::chrono::steady_clock::now();
+
+        distribute(scheduler);
+        {
+            std::unique_lock<std::mutex> lock(scheduler.mutex);
+            scheduler.frames_per_tick = nb_frames;
+            scheduler.workers_done = 0;
+            scheduler.tick += 1;
+            scheduler.tick_started.notify_all();
+            scheduler.tick_finished.wait(lock, [&] { return scheduler.workers_done == scheduler.workers.size(); });
+        }
+
+        SchedulerStats stats{};
+        for (auto& worker : scheduler.workers) {
+            stats.cycles += worker->cycles;
+            stats.frames += worker->frames;
+            stats.tasks += worker->tasks;
+            stats.steals += worker->steals;
+            if (worker->frame_cache) {
+                const FrameCacheStats& cache = worker->frame_cache->stats;
+                stats.frame_cache.hits += cache.hits;
+                stats.frame_cache.misses += cache.misses;
+                stats.frame_cache.evictions += cache.evictions;
+                stats.frame_cache.cycles_saved += cache.cycles_saved;
+            }
+        }
+        for (const CycleDetector& detector : scheduler.detectors) {
+            stats.cycling += detector.found;
+        }
+        stats.seconds = scheduler.stats.seconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        scheduler.stats = stats;
+    }
+
+    void destroy_scheduler(InstanceScheduler& scheduler) {
+        {
+            std::lock_guard<std::mutex> lock(scheduler.mutex);
+            scheduler.quit = true;
+        }
+        scheduler.tick_started.notify_all();
+        for (auto& worker : scheduler.workers) {
+            worker->thread.join();
+        }
+        scheduler.workers.clear();
+
+        for (CHIP8EmulatorState& state : scheduler.instances) {
+            destroy_chip8emulator(state);
+        }
+        scheduler.instances.clear();
+        scheduler.detectors.clear();
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "emulator.h"
+#include "frame_cache.h"
+#include "cycle_detector.h"
+
+namespace chip8 {
+
+    // Number of consecutive instances handed out as one task
+    const size_t SCHEDULER_CHUNK_SIZE = 64;
+
+    struct InstanceRange {
+        size_t begin;
+        size_t end;
+    };
+
+    // Chase-Lev style deque, one per worker
+    //
+    // The ranges are filled before a tick starts and never pushed during it, so only the two
+    // indices are shared: the owner takes from the bottom, thieves steal from the top.
+    struct alignas(C8_CACHE_LINE_SIZE) WorkDeque {
+        std::vector<InstanceRange> ranges;
+
+        alignas(C8_CACHE_LINE_SIZE) std::atomic<int64_t> top{0};
+        alignas(C8_CACHE_LINE_SIZE) std::atomic<int64_t> bottom{0};
+    };
+
+    struct alignas(C8_CACHE_LINE_SIZE) SchedulerWorker {
+        unsigned int id{};
+        std::thread thread;
+        WorkDeque deque;
+
+        // Stats of the worker, only written by its own thread
+        uint64_t cycles{};
+        uint64_t frames{};
+        uint64_t tasks{};
+        uint64_t steals{};
+
+        // Frame memoization of the worker, nullptr when disabled
+        std::unique_ptr<FrameCache> frame_cache;
+    };
+
+    struct SchedulerStats {
+        uint64_t cycles{};
+        uint64_t frames{};
+        uint64_t tasks{};
+        uint64_t steals{};
+        // Instances stopped because they entered a cycle
+        uint64_t cycling{};
+        FrameCacheStats frame_cache;
+        double seconds{};
+    };
+
+    // Thread pool advancing a large set of independent instances by a frame budget per tick
+    //
+    // The instances must only be touched (added, inputs changed, read) between ticks.
+    struct InstanceScheduler {
+        std::vector<CHIP8EmulatorState> instances;
+        unsigned int cycles_per_frame{};
+
+        // One per instance when the cycle detection is enabled, an instance whose detector found a
+        // cycle is not run anymore until its keypad changes
+        bool detect_cycles{};
+        std::vector<CycleDetector> detectors;
+
+        std::vector<std::unique_ptr<SchedulerWorker>> workers;
+
+        // Tick handshake between the caller and the workers
+        std::mutex mutex;
+        std::condition_variable tick_started;
+        std::condition_variable tick_finished;
+        uint64_t tick{};
+        unsigned int frames_per_tick{};
+        unsigned int workers_done{};
+        bool quit{};
+
+        SchedulerStats stats;
+    };
+
+    // nb_workers = 0 uses every hardware thread
+    bool create_scheduler(InstanceScheduler& scheduler, unsigned int nb_workers, unsigned int cycles_per_frame);
+
+    // Memoize the frames of the instances, one cache of nb_entries per worker (0 disables it)
+    // Worth it when many instances sit in the same states (title screens, attract loops).
+    void enable_frame_cache(InstanceScheduler& scheduler, size_t nb_entries);
+
+    // Stop running the instances once they loop forever on a constant input (see CycleDetector)
+    // Meant for headless batch runs: the period and entry frame are reported in detectors.
+    void enable_cycle_detection(InstanceScheduler& scheduler);
+
+    // Return the index of the instance
+    size_t add_instance(InstanceScheduler& scheduler, const CHIP8EmulatorState& state);
+
+    // Call after overwriting an instance between ticks (a new episode): its cycle detection starts
+    // over, a cycle found in the previous run would otherwise keep the new one from running
+    void restart_instance(InstanceScheduler& scheduler, size_t index);
+
+    // Advance every instance by nb_frames frames, block until all are done
+    void run_scheduler_tick(InstanceScheduler& scheduler, unsigned int nb_frames);
+
+    void destroy_scheduler(InstanceScheduler& scheduler);
+}
@@ -0,0 +1,103 @@
+#include "snapshot.h"
+
+namespace chip8 {
+
+    // The hot line of the state is copied as raw bytes, see the layout guards in emulator.h
+    static_assert(sizeof(CHIP8Snapshot::hot) == offsetof(CHIP8EmulatorState, memory),
+                  "The snapshot copies exactly the hot cache line of the state");
+    static_assert(sizeof(CHIP8HiresDisplayPage::rows) == sizeof(CHIP8EmulatorState::display),
+                  "The hires display page is a copy of the display of the state");
+
+    CHIP8Snapshot capture_snapshot(CHIP8EmulatorState& state, const CHIP8Snapshot* parent) {
+        CHIP8Snapshot snapshot;
+        memcpy(snapshot.hot, &state, sizeof(snapshot.hot));
+
+        for (unsigned int page = 0; page < C8_PAGE_COUNT; page++) {
+            bool dirty = (state.dirty_pages >> page) & 0b1;
+            if (parent && !dirty && parent->pages[page]) {
+                snapshot.pages[page] = parent->pages[page];
+            } else {
+                auto copy = std::make_shared<CHIP8Page>();
+                memcpy(copy->bytes, &state.memory[page * C8_PAGE_SIZE], C8_PAGE_SIZE);
+                snapshot.pages[page] = std::move(copy);
+            }
+        }
+
+        bool share_display = parent && !state.dirty_display;
+        if (state.hires && share_display && parent->hires_display) {
+            snapshot.hires_display = parent->hires_display;
+        } else if (state.hires) {
+            auto copy = std::make_shared<CHIP8HiresDisplayPage>();
+            memcpy(copy->rows, state.display, sizeof(copy->rows));
+            snapshot.hires_display = std::move(copy);
+        } else if (share_display && parent->display) {
+            snapshot.display = parent->display;
+        } else {
+            auto copy = std::make_shared<CHIP8DisplayPage>();
+            for (unsigned int y = 0; y < C8_DISPLAY_HEIGHT; y++) {
+                copy->rows[y] = state.display[y * C8_DISPLAY_ROW_WORDS];
+            }
+            snapshot.display = std::move(copy);
+        }
+
+        snapshot.memory_hash = state.memory_hash;
+        snapshot.display_hash = state.display_hash;
+        memcpy(snapshot.rpl, state.rpl, sizeof(snapshot.rpl));
+        snapshot.quirks = state.quirks;
+
+        state.dirty_pages = 0;
+        state.dirty_display = false;
+        return snapshot;
+    }
+
+    void restore_snapshot(const CHIP8Snapshot& snapshot, CHIP8EmulatorState& state,
+                          const CHIP8Snapshot* previous) {
+        memcpy(static_cast<void*>(&state), snapshot.hot, sizeof(snapshot.hot));
+
+        for (unsigned int page = 0; page < C8_PAGE_COUNT; page++) {
+            bool dirty = (state.dirty_pages >> page) & 0b1;
+            if (previous && !dirty && previous->pages[page] == snapshot.pages[page]) {
+                continue;
+            }
+            memcpy(&state.memory[page * C8_PAGE_SIZE], snapshot.pages[page]->bytes, C8_PAGE_SIZE);
+        }
+
+        bool same_display = previous && !state.dirty_display && previous->display == snapshot.display
+                             && previous->hires_display == snapshot.hires_display;
+        if (!same_display && snapshot.hires_display) {
+            memcpy(state.display, snapshot.hires_display->rows, sizeof(state.display));
+        } else if (!same_display) {
+            memset(state.display, 0, sizeof(state.display));
+            for (unsigned int y = 0; y < C8_DISPLAY_HEIGHT; y++) {
+                state.display[y * C8_DISPLAY_ROW_WORDS] = snapshot.display->rows[y];
+            }
+        }
+
+        state.memory_hash = snapshot.memory_hash;
+        state.display_hash = snapshot.display_hash;
+        memcpy(state.rpl, snapshot.rpl, sizeof(state.rpl));
+        state.quirks = snapshot.quirks;
+
+        state.dirty_pages = 0;
+        state.dirty_display = false;
+    }
+
+    void fork_snapshot(const CHIP8Snapshot& parent, const uint16_t* keypads, size_t k,
+                       std::vector<CHIP8Snapshot>& children) {
+        children.resize(k);
+        for (size_t i = 0; i < k; i++) {
+            children[i] = parent;
+            memcpy(&children[i].hot[offsetof(CHIP8EmulatorState, keypad)], &keypads[i], sizeof(uint16_t));
+        }
+    }
+
+    size_t snapshot_private_bytes(const CHIP8Snapshot& snapshot, const CHIP8Snapshot& other) {
+        size_t bytes = sizeof(snapshot.hot);
+        for (unsigned int page = 0; page < C8_PAGE_COUNT; page++) {
+            bytes += snapshot.pages[page] != other.pages[page] ? C8_PAGE_SIZE : 0;
+        }
+        bytes += snapshot.display && snapshot.display != other.display ? sizeof(CHIP8DisplayPage) : 0;
+        bytes += snapshot.hires_display && snapshot.hires_display != other.hires_display ? sizeof(CHIP8HiresDisplayPage) : 0;
+        return bytes;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    struct CHIP8Page {
+        uint8_t bytes[C8_PAGE_SIZE];
+    };
+
+    // 64 x 32 display: the first word of its 32 rows (the rest of the display is blank in this mode)
+    struct CHIP8DisplayPage {
+        uint64_t rows[C8_DISPLAY_HEIGHT];
+    };
+
+    // 128 x 64 display, as stored in the state
+    struct CHIP8HiresDisplayPage {
+        uint64_t rows[C8_HIRES_HEIGHT * C8_DISPLAY_ROW_WORDS];
+    };
+
+    // Compact, immutable copy of an instance
+    //
+    // The hot cache line (registers, stack, timers, keypad, random state) is copied as is. Memory and
+    // display are shared, read-only pages: a snapshot captured from a state restored from another
+    // snapshot only owns the pages written in between, the others point to the pages of its parent.
+    // Copying a snapshot is therefore cheap (64 bytes + 18 reference counts).
+    struct CHIP8Snapshot {
+        alignas(C8_CACHE_LINE_SIZE) uint8_t hot[C8_CACHE_LINE_SIZE]{};
+
+        std::shared_ptr<const CHIP8Page> pages[C8_PAGE_COUNT];
+        // One of them is set, depending on the resolution
+        std::shared_ptr<const CHIP8DisplayPage> display;
+        std::shared_ptr<const CHIP8HiresDisplayPage> hires_display;
+
+        // Incremental hashes, user flags and quirk profile of the state, restored as is
+        uint64_t memory_hash{};
+        uint64_t display_hash{};
+        uint8_t rpl[C8_RPL_FLAGS_SIZE]{};
+        QuirkProfile quirks{};
+    };
+
+    // Capture the state. The pages not written since the state was restored from (or captured as)
+    // parent are shared with it. parent == nullptr copies every page.
+    // The write tracking of the state is cleared, so the state now matches the new snapshot.
+    CHIP8Snapshot capture_snapshot(CHIP8EmulatorState& state, const CHIP8Snapshot* parent);
+
+    // Overwrite the state with the snapshot.
+    // If the state currently matches the snapshot previous (last restored or captured), the pages
+    // shared by both and not written since are left untouched instead of being copied again.
+    void restore_snapshot(const CHIP8Snapshot& snapshot, CHIP8EmulatorState& state,
+                          const CHIP8Snapshot* previous = nullptr);
+
+    // Clone a snapshot into k children sharing all of its pages, children[i] gets keypads[i] as input.
+    // Each child continues by restore_snapshot + emulate + capture_snapshot(state, &child),
+    // only copying the pages it writes.
+    void fork_snapshot(const CHIP8Snapshot& parent, const uint16_t* keypads, size_t k,
+                       std::vector<CHIP8Snapshot>& children);
+
+    // Bytes of page data not shared with the other snapshot (approximation of the cost of a child)
+    size_t snapshot_private_bytes(const CHIP8Snapshot& snapshot, const CHIP8Snapshot& other);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace chip8 {
+
+    // Lock-free single-producer/single-consumer ring buffer
+    //
+    // The producer only moves tail and the consumer only moves head, so each index has a single
+    // writer. Both are kept on their own cache line to avoid false sharing between the two threads.
+    // CAPACITY must be a power of two.
+    template <typename T, size_t CAPACITY>
+    struct SPSCQueue {
+        static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+        T slots[CAPACITY]{};
+
+        // Next slot to read (consumer)
+        alignas(64) std::atomic<size_t> head{0};
+
+        // Next slot to write (producer)
+        alignas(64) std::atomic<size_t> tail{0};
+    };
+
+    // Return false if the queue is full
+    template <typename T, size_t CAPACITY>
+    bool spsc_push(SPSCQueue<T, CAPACITY>& queue, const T& value) {
+        size_t tail = queue.tail.load(std::memory_order_relaxed);
+        if (tail - queue.head.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        queue.slots[tail & (CAPACITY - 1)] = value;
+        queue.tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Copy the oldest value without removing it
+    // Return false if the queue is empty
+    template <typename T, size_t CAPACITY>
+    bool spsc_peek(const SPSCQueue<T, CAPACITY>& queue, T& value) {
+        size_t head = queue.head.load(std::memory_order_relaxed);
+        if (head == queue.tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = queue.slots[head & (CAPACITY - 1)];
+        return true;
+    }
+
+    // Remove the oldest value. Must follow a successful spsc_peek.
+    template <typename T, size_t CAPACITY>
+    void spsc_pop(SPSCQueue<T, CAPACITY>& queue) {
+        queue.head.store(queue.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace chip8 {
+
+    // Lock-free single-producer/single-consumer triple buffer
+    //
+    // The producer always owns the "back" slot and the consumer the "front" slot. The third
+    // slot sits in the middle and is exchanged atomically by both sides:
+    //  * publish: the producer swaps its finished back slot with the middle one
+    //  * acquire: the consumer swaps its front slot with the middle one, only if it is fresh
+    // Neither side ever waits for the other and the consumer always sees a complete value.
+    template <typename T>
+    struct TripleBuffer {
+        static constexpr uint8_t INDEX_MASK = 0b011;
+        static constexpr uint8_t FRESH_BIT = 0b100;
+
+        T slots[3]{};
+
+        // Only touched by the producer
+        uint8_t back = 0;
+
+        // Only touched by the consumer
+        uint8_t front = 1;
+
+        // Index of the middle slot + whether it holds a value not acquired yet
+        std::atomic<uint8_t> middle{2};
+    };
+
+    // Slot the producer is allowed to write into
+    template <typename T>
+    T& triple_buffer_write(TripleBuffer<T>& tb) {
+        return tb.slots[tb.back];
+    }
+
+    // Make the write slot visible to the consumer
+    template <typename T>
+    void triple_buffer_publish(TripleBuffer<T>& tb) {
+        uint8_t previous = tb.middle.exchange(tb.back | TripleBuffer<T>::FRESH_BIT, std::memory_order_acq_rel);
+        tb.back = previous & TripleBuffer<T>::INDEX_MASK;
+    }
+
+    // Move the newest published value (if any) to the read slot
+    // Return true if the read slot changed
+    template <typename T>
+    bool triple_buffer_acquire(TripleBuffer<T>& tb) {
+        if (!(tb.middle.load(std::memory_order_relaxed) & TripleBuffer<T>::FRESH_BIT)) {
+            return false;
+        }
+        uint8_t previous = tb.middle.exchange(tb.front, std::memory_order_acq_rel);
+        tb.front = previous & TripleBuffer<T>::INDEX_MASK;
+        return true;
+    }
+
+    // Slot the consumer is allowed to read from
+    template <typename T>
+    const T& triple_buffer_read(const TripleBuffer<T>& tb) {
+        return tb.slots[tb.front];
+    }
+}
@@ -0,0 +1,300 @@
+#include "xochip.h"
+#include "interpreter.h"
+
+namespace chip8 {
+
+    static_assert(sizeof(XOCHIPState::display) == C8_HIRES_HEIGHT * 32, "A display line of both planes is one 256-bit vector");
+
+    void create_xochip(XOCHIPState& state) {
+        state = XOCHIPState{};
+        reset_state(state);
+
+        for(unsigned int i = 0; i < C8_FONTSET_SIZE; i+=1) {
+            state.memory[C8_FONTSET_START_ADDRESS + i] = C8_FONTSET[i];
+        }
+        for(unsigned int i = 0; i < C8_BIGFONTSET_SIZE; i+=1) {
+            state.memory[C8_BIGFONTSET_START_ADDRESS + i] = C8_BIGFONTSET[i];
+        }
+        rehash_state(state);
+    }
+
+    void seed_random(XOCHIPState& state, uint64_t seed) {
+        state.rng = random_state_from_seed(seed);
+    }
+
+    void reset_state(XOCHIPState& state) {
+        memset(state.V, 0, sizeof(state.V));
+        memset(&state.memory[C8_START_ADDRESS], 0, XO_MEMORY_SIZE - C8_START_ADDRESS);
+        state.pc = C8_START_ADDRESS;
+        state.opcode = 0;
+        state.I = 0;
+
+        state.sp = 0;
+        memset(state.stack, 0, sizeof(state.stack));
+
+        state.delay_timer = 0;
+        state.sound_timer = 0;
+
+        memset(state.display, 0, sizeof(state.display));
+        state.hires = 0;
+        state.planes = 1;
+        state.pitch = XO_DEFAULT_PITCH;
+        memset(state.audio_pattern, 0, sizeof(state.audio_pattern));
+        memset(state.rpl, 0, sizeof(state.rpl));
+
+        state.dirty_display = true;
+        rehash_state(state);
+    }
+
+    void load_rom_from_buffer(XOCHIPState& state, uint8_t* rom, int size) {
+        reset_state(state);
+        size = std::min<int>(size, XO_MEMORY_SIZE - C8_START_ADDRESS);
+        std::copy(rom, rom + size, state.memory + C8_START_ADDRESS);
+        rehash_state(state);
+    }
+
+    void destroy_xochip(XOCHIPState& state) {
+        // Nothing to do here
+    }
+
+    // Hash of a display word at index (row * XO_ROW_WORDS + word) for the display hash
+    static inline uint64_t display_word_hash(unsigned int index, uint64_t word) {
+        return location_word_hash(XO_MEMORY_SIZE + index, word);
+    }
+
+    static void rehash_display(XOCHIPState& state) {
+        state.display_hash = 0;
+        for (unsigned int index = 0; index < C8_HIRES_HEIGHT * XO_ROW_WORDS; index++) {
+            state.display_hash ^= display_word_hash(index, state.display[index]);
+        }
+    }
+
+    // 128-bit row of plane p at line y
+    static inline uint64_t* plane_row(XOCHIPState& state, unsigned int y, unsigned int p) {
+        return &state.display[y * XO_ROW_WORDS + p * C8_DISPLAY_ROW_WORDS];
+    }
+
+    static inline bool is_plane_selected(const XOCHIPState& state, unsigned int p) {
+        return (state.planes >> p) & 0b1;
+    }
+
+#if defined(C8_AVX2_KERNELS)
+    C8_TARGET_AVX2 static bool xor_row_avx2(uint64_t* row, const uint64_t* mask) {
+        __m256i r = _mm256_load_si256(reinterpret_cast<const __m256i*>(row));
+        __m256i m = _mm256_load_si256(reinterpret_cast<const __m256i*>(mask));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(row), _mm256_xor_si256(r, m));
+        return !_mm256_testz_si256(r, m);
+    }
+#endif
+
+    // XOR mask into both planes of display line y, return true if a lit pixel was turned off
+    static inline bool xor_display_row(XOCHIPState& state, unsigned int y, const uint64_t* mask) {
+        uint64_t* row = &state.display[y * XO_ROW_WORDS];
+        for (unsigned int w = 0; w < XO_ROW_WORDS; w++) {
+            if (mask[w]) {
+                state.display_hash ^= display_word_hash(y * XO_ROW_WORDS + w, row[w])
+                                      ^ display_word_hash(y * XO_ROW_WORDS + w, row[w] ^ mask[w]);
+            }
+        }
+
+#if defined(C8_AVX2_KERNELS)
+        if (cpu_has_avx2()) {
+            return xor_row_avx2(row, mask);
+        }
+#endif
+        uint64_t overlap = 0;
+        for (unsigned int w = 0; w < XO_ROW_WORDS; w++) {
+            overlap |= row[w] & mask[w];
+            row[w] ^= mask[w];
+        }
+        return overlap != 0;
+    }
+
+    ///////////////////////
+    // STATE ACCESS (see interpreter.h)
+    ///////////////////////
+
+    static inline void write_memory(XOCHIPState& state, unsigned int address, uint8_t value) {
+        address &= XO_MEMORY_SIZE - 1;
+        state.memory_hash ^= location_hash(address, state.memory[address]) ^ location_hash(address, value);
+        state.memory[address] = value;
+    }
+
+    // Only the selected planes are cleared
+    static void clear_display(XOCHIPState& state) {
+        for (unsigned int y = 0; y < C8_HIRES_HEIGHT; y++) {
+            for (unsigned int p = 0; p < XO_PLANE_COUNT; p++) {
+                if (is_plane_selected(state, p)) {
+                    memset(plane_row(state, y, p), 0, C8_DISPLAY_ROW_WORDS * sizeof(uint64_t));
+                }
+            }
+        }
+
+        state.dirty_display = true;
+        rehash_display(state);
+    }
+
+    // Every plane is cleared, whatever the selection
+    static void set_resolution(XOCHIPState& state, bool hires) {
+        state.hires = hires;
+        memset(state.display, 0, sizeof(state.display));
+        state.dirty_display = true;
+        state.display_hash = 0;
+    }
+
+    static void scroll_display_down(XOCHIPState& state, unsigned int n) {
+        const unsigned int height = display_height(state);
+        for (unsigned int p = 0; p < XO_PLANE_COUNT; p++) {
+            if (!is_plane_selected(state, p)) {
+                continue;
+            }
+            for (unsigned int y = height; y-- > 0;) {
+                uint64_t* row = plane_row(state, y, p);
+                const uint64_t* from = y >= n ? plane_row(state, y - n, p) : nullptr;
+                row[0] = from ? from[0] : 0;
+                row[1] = from ? from[1] : 0;
+            }
+        }
+
+        state.dirty_display = true;
+        rehash_display(state);
+    }
+
+    static void scroll_display_up(XOCHIPState& state, unsigned int n) {
+        const unsigned int height = display_height(state);
+        for (unsigned int p = 0; p < XO_PLANE_COUNT; p++) {
+            if (!is_plane_selected(state, p)) {
+                continue;
+            }
+            for (unsigned int y = 0; y < height; y++) {
+                uint64_t* row = plane_row(state, y, p);
+                const uint64_t* from = y + n < height ? plane_row(state, y + n, p) : nullptr;
+                row[0] = from ? from[0] : 0;
+                row[1] = from ? from[1] : 0;
+            }
+        }
+
+        state.dirty_display = true;
+        rehash_display(state);
+    }
+
+    static void scroll_display_right(XOCHIPState& state) {
+        const unsigned int height = display_height(state);
+        for (unsigned int p = 0; p < XO_PLANE_COUNT; p++) {
+            if (!is_plane_selected(state, p)) {
+                continue;
+            }
+            for (unsigned int y = 0; y < height; y++) {
+                uint64_t* row = plane_row(state, y, p);
+                row[1] = state.hires ? (row[1] >> 4) | (row[0] << 60) : 0;
+                row[0] = row[0] >> 4;
+            }
+        }
+
+        state.dirty_display = true;
+        rehash_display(state);
+    }
+
+    static void scroll_display_left(XOCHIPState& state) {
+        const unsigned int height = display_height(state);
+        for (unsigned int p = 0; p < XO_PLANE_COUNT; p++) {
+            if (!is_plane_selected(state, p)) {
+                continue;
+            }
+            for (unsigned int y = 0; y < height; y++) {
+                uint64_t* row = plane_row(state, y, p);
+                row[0] = (row[0] << 4) | (row[1] >> 60);
+                row[1] = row[1] << 4;
+            }
+        }
+
+        state.dirty_display = true;
+        rehash_display(state);
+    }
+
+    // Draw the N rows sprite at I (16 x 16 if N = 0) at (x, y) on the selected planes, wrapping
+    // around the edges of the display or clipped by them. The sprite of the second plane follows the one of the
+    // first in memory when both are selected. Return true on collision in any plane.
+    static bool draw_sprite(XOCHIPState& state, unsigned int x, unsigned int y, unsigned int n, bool clip) {
+        const unsigned int width = display_width(state);
+        const unsigned int height = display_height(state);
+        x %= width;
+        y %= height;
+
+        const bool large = n == 0;
+        const unsigned int nb_rows = large ? 16 : n;
+        const unsigned int row_bytes = large ? 2 : 1;
+
+        unsigned int sprite_address[XO_PLANE_COUNT];
+        unsigned int address = state.I;
+        for (unsigned int p = 0; p < XO_PLANE_COUNT; p++) {
+            sprite_address[p] = address;
+            address += is_plane_selected(state, p) ? nb_rows * row_bytes : 0;
+        }
+
+        bool collision = false;
+        state.dirty_display = true;
+
+        for (unsigned int irow = 0; irow < nb_rows && (!clip || y + irow < height); irow++) {
+            alignas(32) uint64_t mask[XO_ROW_WORDS] = {};
+            for (unsigned int p = 0; p < XO_PLANE_COUNT; p++) {
+                if (!is_plane_selected(state, p)) {
+                    continue;
+                }
+
+                unsigned int at = sprite_address[p] + irow * row_bytes;
+                uint64_t sprite = large ? (read_memory(state, at) << 8) | read_memory(state, at + 1)
+                                        : read_memory(state, at);
+                place_sprite_row(&mask[p * C8_DISPLAY_ROW_WORDS], x, sprite, large ? 16 : 8, width, clip);
+            }
+
+            collision |= xor_display_row(state, (y + irow) % height, mask);
+        }
+
+        return collision;
+    }
+
+    ///////////////////////
+    // INTERPRETER
+    ///////////////////////
+
+    size_t patch_rom(XOCHIPState& state, const uint8_t* old_rom, size_t old_size, const uint8_t* rom, size_t size) {
+        return patch_rom_image(state, old_rom, old_size, rom, size);
+    }
+
+    void emulate_cycle(XOCHIPState& state) {
+        interpret_cycle(state);
+    }
+
+    void update_timers(XOCHIPState& state) {
+        interpret_timers(state);
+    }
+
+    unsigned int emulate_frame(XOCHIPState& state, unsigned int nb_cycles) {
+        return interpret_frame(state, nb_cycles);
+    }
+
+    uint64_t hash_state(const XOCHIPState& state) {
+        // Cold registers: planes, pitch, quirk profile, audio pattern and user flags
+        uint8_t cold[40]{};
+        cold[0] = state.planes;
+        cold[1] = state.pitch;
+        cold[2] = static_cast<uint8_t>(state.quirks);
+        memcpy(&cold[3], state.audio_pattern, sizeof(state.audio_pattern));
+        memcpy(&cold[3 + sizeof(state.audio_pattern)], state.rpl, sizeof(state.rpl));
+
+        uint64_t h = hash_hot_line(state);
+        h = hash_bytes(h, cold, sizeof(cold));
+        h ^= state.memory_hash ^ state.display_hash;
+        return finalize_hash(h);
+    }
+
+    void rehash_state(XOCHIPState& state) {
+        state.memory_hash = 0;
+        for (unsigned int address = 0; address < XO_MEMORY_SIZE; address++) {
+            state.memory_hash ^= location_hash(address, state.memory[address]);
+        }
+
+        rehash_display(state);
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "emulator.h"
+
+namespace chip8 {
+
+    // XO-CHIP (Octo) extensions of SUPER-CHIP: 64 KiB of memory, F000 NNNN, 5XY2/5XY3, 00DN,
+    // 2 drawing planes (4 colours) selected by FN01, audio pattern (F002) and pitch (FX3A)
+    const unsigned int XO_MEMORY_SIZE = 65536;
+    const unsigned int XO_PLANE_COUNT = 2;
+    const unsigned int XO_RPL_FLAGS_SIZE = 16;
+
+    // Both planes of a display line are stored side by side:
+    //   [plane 0 word 0, plane 0 word 1, plane 1 word 0, plane 1 word 1]
+    // A sprite drawn on both planes updates a single 256-bit vector per line.
+    const unsigned int XO_ROW_WORDS = XO_PLANE_COUNT * C8_DISPLAY_ROW_WORDS;
+
+    // 1-bit samples played in a loop while the sound timer is active, at 4000 * 2^((pitch - 64) / 48) hz
+    const unsigned int XO_AUDIO_PATTERN_SIZE = 16;
+    const uint8_t XO_DEFAULT_PITCH = 64;
+
+    // Own state type so the 64 KiB memory only costs the XO-CHIP ROMs: CHIP8EmulatorState is unchanged
+    // The hot cache line has the exact layout of CHIP8EmulatorState, memory comes last.
+    struct alignas(C8_CACHE_LINE_SIZE) XOCHIPState {
+        static constexpr Platform platform = Platform::XOCHIP;
+        static constexpr unsigned int memory_size = XO_MEMORY_SIZE;
+
+        ////////////////////////////////
+        // Hot: first cache line (64 bytes), see CHIP8EmulatorState
+        ////////////////////////////////
+        uint8_t V[C8_REGISTER_SIZE]{};
+        uint16_t pc{};
+        uint16_t I{};
+        uint16_t opcode{};
+        uint16_t keypad{};
+        uint8_t sp{};
+        uint8_t delay_timer{};
+        uint8_t sound_timer{};
+        uint8_t hires{};
+        uint32_t rng{C8_DEFAULT_SEED};
+        alignas(32) uint16_t stack[16]{};
+
+        ////////////////////////////////
+        // Cold registers and bookkeeping: one cache line
+        ////////////////////////////////
+
+        // Incremental hashes, see CHIP8EmulatorState
+        alignas(C8_CACHE_LINE_SIZE) uint64_t memory_hash{};
+        uint64_t display_hash{};
+
+        // * set when the display has been written
+        bool dirty_display{};
+
+        // Interpreter behaviours of the ROM, Octo's by default
+        QuirkProfile quirks{QuirkProfile::XOChip};
+
+        ////// Planes ///////
+        // * bit p set: plane p is drawn, cleared and scrolled (FN01)
+        uint8_t planes{1};
+
+        ////// Audio ///////
+        uint8_t pitch{XO_DEFAULT_PITCH};
+        uint8_t audio_pattern[XO_AUDIO_PATTERN_SIZE]{};
+
+        ////// User flags ///////
+        uint8_t rpl[XO_RPL_FLAGS_SIZE]{};
+
+        ////////////////////////////////
+        // Cold: bulk arrays
+        ////////////////////////////////
+
+        ////// Graphics Display ///////
+        // * 128 x 64 pixels of 2 bits (one per plane), only the top-left 64 x 32 pixels are used in lores mode
+        alignas(C8_CACHE_LINE_SIZE) uint64_t display[C8_HIRES_HEIGHT * XO_ROW_WORDS]{};
+
+        /////// Memory ///////
+        // * Same map as CHIP-8 (font at 0x50, program at 0x200) up to 0xFFFF
+        uint8_t memory[XO_MEMORY_SIZE]{};
+    };
+
+    static_assert(offsetof(XOCHIPState, pc) == offsetof(CHIP8EmulatorState, pc)
+                  && offsetof(XOCHIPState, hires) == offsetof(CHIP8EmulatorState, hires)
+                  && offsetof(XOCHIPState, stack) == offsetof(CHIP8EmulatorState, stack),
+                  "The hot cache line of XOCHIPState must match the one of CHIP8EmulatorState");
+    static_assert(offsetof(XOCHIPState, memory_hash) == C8_CACHE_LINE_SIZE, "The cold registers must follow the hot cache line");
+    static_assert(offsetof(XOCHIPState, rpl) + sizeof(XOCHIPState::rpl) <= offsetof(XOCHIPState, display),
+                  "The cold registers must fit in a single cache line");
+    static_assert(offsetof(XOCHIPState, display) % C8_CACHE_LINE_SIZE == 0, "display must be cache line aligned");
+
+    inline bool is_key_pressed(const XOCHIPState& state, uint8_t key) {
+        return is_key_pressed(state.keypad, key);
+    }
+
+    inline void set_key(XOCHIPState& state, uint8_t key, bool pressed) {
+        uint16_t mask = 1u << (key & 0x0Fu);
+        state.keypad = pressed ? (state.keypad | mask) : (state.keypad & ~mask);
+    }
+
+    inline unsigned int display_width(const XOCHIPState& state) {
+        return state.hires ? C8_HIRES_WIDTH : C8_DISPLAY_WIDTH;
+    }
+
+    inline unsigned int display_height(const XOCHIPState& state) {
+        return state.hires ? C8_HIRES_HEIGHT : C8_DISPLAY_HEIGHT;
+    }
+
+    // Colour index of a pixel: bit p is the pixel of plane p
+    inline uint8_t get_pixel(const XOCHIPState& state, unsigned int x, unsigned int y) {
+        const uint64_t* row = &state.display[y * XO_ROW_WORDS + x / 64];
+        unsigned int shift = 63 - x % 64;
+        return ((row[0] >> shift) & 0b1) | (((row[C8_DISPLAY_ROW_WORDS] >> shift) & 0b1) << 1);
+    }
+
+    // Playback rate of the audio pattern bits in hz
+    inline float audio_pattern_rate(const XOCHIPState& state) {
+        return 4000.f * std::pow(2.f, (static_cast<float>(state.pitch) - 64.f) / 48.f);
+    }
+
+    // The state is 68 KiB: it is initialized in place instead of returned by value
+    void create_xochip(XOCHIPState& state);
+
+    void seed_random(XOCHIPState& state, uint64_t seed);
+
+    void reset_state(XOCHIPState& state);
+
+    // ROMs larger than the memory after 0x200 are truncated
+    void load_rom_from_buffer(XOCHIPState& state, uint8_t* rom, int size);
+
+    // Same contracts as the CHIP8EmulatorState versions
+    size_t patch_rom(XOCHIPState& state, const uint8_t* old_rom, size_t old_size, const uint8_t* rom, size_t size);
+
+    void emulate_cycle(XOCHIPState& state);
+
+    void update_timers(XOCHIPState& state);
+
+    unsigned int emulate_frame(XOCHIPState& state, unsigned int nb_cycles);
+
+    uint64_t hash_state(const XOCHIPState& state);
+
+    void rehash_state(XOCHIPState& state);
+
+    void destroy_xochip(XOCHIPState& state);
+}